@@ -4,9 +4,14 @@ SERIAL_DIR = submodule/wb-mqtt-serial
 JSONCPP_DIR = submodule/valijson/thirdparty/jsoncpp-1.9.4
 
 WASM_DIR = wasm
+BUILD_DIR = build
 ASSETS_DIR = $(WASM_DIR)/assets
 PROTOCOLS_DIR = $(ASSETS_DIR)/protocols
-TEMPLATES_DIR = $(ASSETS_DIR)/templates
+PRECOMPUTED_DIR = $(ASSETS_DIR)/precomputed
+TEMPLATES_DIR = $(BUILD_DIR)/templates
+TEMPLATES_PACK = $(ASSETS_DIR)/templates.pack
+
+SCHEMAS_GENERATOR = $(BUILD_DIR)/schemas-generator.js
 
 INC = \
 	.                       \
@@ -56,9 +61,25 @@ SRC = \
 	$(SERIAL_DIR)/src/rpc/rpc_exception.cpp                    \
 	$(SERIAL_DIR)/src/rpc/rpc_helpers.cpp                      \
 	$(SERIAL_DIR)/src/rpc/rpc_port_scan_serial_client_task.cpp \
+	$(WASM_DIR)/src/wasm_channel_monitor.cpp                   \
+	$(WASM_DIR)/src/wasm_device_types_index.cpp                \
+	$(WASM_DIR)/src/wasm_firmware_update.cpp                   \
+	$(WASM_DIR)/src/wasm_modbus.cpp                            \
 	$(WASM_DIR)/src/wasm_port.cpp                              \
+	$(WASM_DIR)/src/wasm_precomputed.cpp                       \
+	$(WASM_DIR)/src/wasm_replay_port.cpp                       \
+	$(WASM_DIR)/src/wasm_reply_cache.cpp                       \
+	$(WASM_DIR)/src/wasm_response_timeouts.cpp                 \
+	$(WASM_DIR)/src/wasm_socket_port.cpp                       \
+	$(WASM_DIR)/src/wasm_templates_pack.cpp                    \
+	$(WASM_DIR)/src/wasm_trace.cpp                             \
 	$(WASM_DIR)/src/wasm_module.cpp                            \
 
+SCHEMAS_GENERATOR_SRC = \
+	$(filter $(SERIAL_DIR)/%, $(SRC))       \
+	$(WASM_DIR)/src/wasm_precomputed.cpp    \
+	$(WASM_DIR)/tools/schemas_generator.cpp \
+
 JINJA_TEMPLATES = \
 	$(wildcard $(SERIAL_DIR)/templates/config-map*.json.jinja) \
 	$(wildcard $(SERIAL_DIR)/templates/config-wb-*.json.jinja) \
@@ -68,10 +89,26 @@ OPT = \
 	-lembind                                        \
 	-sASYNCIFY                                      \
 	-sASYNCIFY_IMPORTS=["emscripten_asm_const_int"] \
+	-sUSE_ZLIB=1                                    \
+	-sMODULARIZE=1                                  \
+	-sEXPORT_NAME=createModule                      \
+	-sEXPORTED_RUNTIME_METHODS=FS                   \
+	-sALLOW_MEMORY_GROWTH=1                         \
+	-sMAXIMUM_MEMORY=512MB                          \
+
+SCHEMAS_GENERATOR_OPT = \
+	-fexceptions            \
+	-sNODERAWFS=1           \
+	-sALLOW_MEMORY_GROWTH=1 \
+	-sUSE_ZLIB=1            \
 
 TEMPLATES = $(JINJA_TEMPLATES:.json.jinja=.json)
 
-all: templates
+all: schemas
+# build module
+	$(CC) -v -O3 $(addprefix -I, $(INC)) $(SRC) wblib/static/wblib.a -o $(WASM_DIR)/public/module.js --preload-file $(ASSETS_DIR)@/ $(OPT)
+
+assets: templates
 # copy assets
 	mkdir -p $(PROTOCOLS_DIR)
 	cp $(SERIAL_DIR)/protocols/modbus.schema.json $(PROTOCOLS_DIR)
@@ -81,13 +118,19 @@ all: templates
 	cp $(SERIAL_DIR)/wb-mqtt-serial-device-template.schema.json $(ASSETS_DIR)
 # fix include
 	cp -r $(JSONCPP_DIR)/include/json wblib/
-# build module
-	$(CC) -v -O3 $(addprefix -I, $(INC)) $(SRC) wblib/static/wblib.a -o $(WASM_DIR)/public/module.js --preload-file $(ASSETS_DIR)@/ $(OPT)
+
+# precompute schemas with the same generator running in Node.js
+schemas: assets
+	mkdir -p $(BUILD_DIR)
+	$(CC) -O2 $(addprefix -I, $(INC)) $(SCHEMAS_GENERATOR_SRC) wblib/static/wblib.a -o $(SCHEMAS_GENERATOR) $(SCHEMAS_GENERATOR_OPT)
+	rm -rf $(PRECOMPUTED_DIR)
+	cd $(ASSETS_DIR) && node $(abspath $(SCHEMAS_GENERATOR)) $(abspath $(TEMPLATES_DIR))
 
 templates: $(TEMPLATES)
 	cp $(SERIAL_DIR)/templates/config-map*.json $(TEMPLATES_DIR)
 	cp $(SERIAL_DIR)/templates/config-wb-*.json $(TEMPLATES_DIR)
 	grep -r '"deprecated"' $(TEMPLATES_DIR) | grep 'true' | awk -F ':' '{print $$1}' | xargs rm
+	python3 $(WASM_DIR)/tools/pack_templates.py $(TEMPLATES_DIR) $(TEMPLATES_PACK)
 
 $(TEMPLATES): %.json: %.json.jinja
 	mkdir -p $(TEMPLATES_DIR)
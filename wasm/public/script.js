@@ -1,53 +1,274 @@
 let wasmReadyResolve;
 
+// Module instance serving one serial adapter. Asyncify suspends a single C++ stack at a time, so requests of an
+// instance are executed one by one, while instances of different adapters run concurrently.
+class ModuleInstance {
+    // lower value means higher priority, requests of the same class are executed in FIFO order
+    static priorities = {
+        interactive: 0,
+        background: 1,
+        scan: 2,
+    };
+
+    // requests which aren't recorded to the serial trace, they don't belong to the replayed session
+    static untraced = ['init', 'traceSave', 'replayStart', 'replayStats', 'heapStats'];
+
+    queue = new Array();
+    busy = false;
+    tracing = false;
+    heapUsageEnabled = false;
+
+    constructor(serial) {
+        this.serial = serial;
+    }
+
+    request(type, data, priority = 'interactive', onProgress = null) {
+        return new Promise((resolve) => {
+            this.queue.push({
+                type: type,
+                data: data,
+                priority: ModuleInstance.priorities[priority] ?? 0,
+                onProgress: onProgress,
+                resolve: resolve,
+            });
+            this.schedule();
+        });
+    }
+
+    schedule() {
+        if (this.busy || !this.queue.length)
+            return;
+
+        let index = 0;
+
+        for (let i = 1; i < this.queue.length; i++) {
+            if (this.queue[i].priority < this.queue[index].priority)
+                index = i;
+        }
+
+        let [item] = this.queue.splice(index, 1);
+        this.busy = true;
+
+        this.execute(item.type, item.data, item.onProgress).then((reply) => {
+            this.busy = false;
+            item.resolve(reply);
+            this.schedule();
+        });
+    }
+
+    async execute(type, data, onProgress) {
+        let json = JSON.stringify(data);
+
+        function wait(resolve) {
+            if (this.finished) {
+                resolve();
+                return;
+            }
+
+            setTimeout(wait.bind(this, resolve), 1);
+        }
+
+        this.finished = false;
+        this.onProgress = onProgress;
+
+        if (this.tracing && !ModuleInstance.untraced.includes(type))
+            this.traceRequest(type, json);
+
+        let heapUsage = this.heapUsageEnabled ? this.getHeapUsage() : null;
+        let start = performance.now();
+
+        switch (type) {
+            case 'init': this.init(json); break;
+            case 'configGetDeviceTypes': this.configGetDeviceTypes(json); break;
+            case 'configGetSchema': this.configGetSchema(json); break;
+            case 'configGetCommonSchema': this.configGetCommonSchema(json); break;
+            case 'configMatchDeviceTypes': this.configMatchDeviceTypes(json); break;
+            case 'portScan': this.portScan(json); break;
+            case 'portSniff': this.portSniff(json); break;
+            case 'deviceLoadConfig': this.deviceLoadConfig(json); break;
+            case 'deviceSet': this.deviceSet(json); break;
+            case 'firmwareUpdate': this.firmwareUpdate(json); break;
+            case 'monitorStart': this.monitorStart(json); break;
+            case 'monitorPoll': this.monitorPoll(json); break;
+            case 'monitorStop': this.monitorStop(json); break;
+            case 'traceSave': this.traceSave(json); break;
+            case 'replayStart': this.replayStart(json); break;
+            case 'replayStats': this.replayStats(json); break;
+            case 'heapStats': this.heapStats(json); break;
+        }
+
+        await new Promise(wait.bind(this));
+
+        if (heapUsage)
+            this.printHeapUsage(type, heapUsage, performance.now() - start);
+
+        return this.reply;
+    }
+
+    // Logs the change of the heap by the request, growth of the heap size means that freed memory couldn't be reused
+    printHeapUsage(type, before, time) {
+        let after = this.getHeapUsage();
+        let kilobytes = (bytes) => (bytes > 0 ? '+' : '') + (bytes / 1024).toFixed(1) + ' KB';
+
+        this.print(type + ' in ' + Math.round(time) + ' ms, heap used ' + kilobytes(after.used - before.used) +
+                   ', heap size ' + kilobytes(after.size - before.size) + ' (' + (after.size / 1048576).toFixed(1) +
+                   ' MB, ' + (after.free / 1048576).toFixed(1) + ' MB free)');
+    }
+
+    parseReply(reply) {
+        this.reply = JSON.parse(reply);
+
+        if (this.reply.error)
+            this.print('request error ' + this.reply.error.code + ': ' + this.reply.error.message);
+
+        this.finished = true;
+    }
+
+    parseProgress(progress) {
+        if (this.onProgress)
+            this.onProgress(JSON.parse(progress));
+    }
+
+    setStatus(text) {
+        this.print(text);
+    }
+
+    print(text) {
+        console.log(text);
+    }
+}
+
 window.Module =
   {
       isReady: new Promise((resolve) => {
           wasmReadyResolve = resolve;
       }),
 
-      onRuntimeInitialized() {
-          this.serial = new SerialPort();
+      // memory budget for serialized schema and device type replies, zero keeps the module default of an eighth of
+      // the largest heap
+      replyCacheSize: 0,
+
+      // heap usage of a module instance after which its caches are dropped, zero keeps the module default of a half
+      // of the largest heap
+      heapBudget: 0,
+
+      // templates are prepared in background right after loading, add ?warmup=0 to the URL to compare with
+      // initialization on the first device request
+      warmUpEnabled: new URLSearchParams(window.location.search).get('warmup') !== '0',
+
+      initStatus: { progress: 0 },
+
+      // requests are sent together with reading of replies, add ?transact=0 to the URL to compare the Asyncify
+      // overhead logged after each request with separate write and read calls
+      transactEnabled: new URLSearchParams(window.location.search).get('transact') !== '0',
+
+      // all port operations are recorded to a trace which can be saved for a bug report and replayed by
+      // wasm/tools/replay.js, add ?trace=1 to the URL to enable it
+      traceEnabled: new URLSearchParams(window.location.search).get('trace') === '1',
+
+      // heap usage change is logged after each request, add ?heapusage=1 to the URL to enable it
+      heapUsageEnabled: new URLSearchParams(window.location.search).get('heapusage') === '1',
+
+      // module instances, one per serial adapter, requests without a port id are served by the first one
+      ports: new Array(),
+
+      get serial() {
+          return this.ports[0]?.serial;
+      },
+
+      async start() {
+          await this.addPort();
           wasmReadyResolve();
       },
 
-      async request(type, data) {
-          let json = JSON.stringify(data);
+      // Creates a module instance with its own serial adapter or gateway connection, returns the port id. Gateways
+      // use 'rtu-over-tcp' or 'modbus-tcp' transport and are connected by a WebSocket URL. With select set the user
+      // chooses the adapter first, while the click which added the port still allows it, and no instance is created
+      // if the choice is cancelled.
+      async addPort(transport = 'serial', url = null, select = false) {
+          let serial = transport === 'serial' ? new SerialPort() : new WebSocketPort(url);
 
-          function wait(resolve) {
-              if (this.finished) {
-                  resolve();
-                  return;
-              }
+          if (select)
+              await serial.select(true);
 
-              setTimeout(wait.bind(this, resolve), 1);
-          }
+          let instance = await createModule(new ModuleInstance(serial));
+          let port = this.ports.length;
+
+          instance.setTransport(transport);
+
+          if (this.replyCacheSize)
+              instance.setReplyCacheSize(this.replyCacheSize);
+
+          if (this.heapBudget)
+              instance.setHeapBudget(this.heapBudget);
 
-          this.finished = false;
+          instance.setTransactEnabled(this.transactEnabled);
+          instance.heapUsageEnabled = this.heapUsageEnabled;
+          this.ports.push(instance);
 
-          switch (type) {
-              case 'configGetDeviceTypes': this.configGetDeviceTypes(json); break;
-              case 'configGetSchema': this.configGetSchema(json); break;
-              case 'portScan': this.portScan(json); break;
-              case 'deviceLoadConfig': this.deviceLoadConfig(json); break;
-              case 'deviceSet': this.deviceSet(json); break;
+          if (this.traceEnabled) {
+              instance.traceStart();
+              instance.tracing = true;
           }
 
-          await new Promise(wait.bind(this));
-          return this.reply;
+          if (this.warmUpEnabled)
+              this.warmUp(port);
+
+          return port;
+      },
+
+      async request(type, data, priority = 'interactive', onProgress = null) {
+          await this.isReady;
+
+          let { port = 0, ...params } = data ?? {};
+          return await this.ports[port].request(type, params, priority, onProgress);
       },
 
-      parseReply(reply) {
-          this.reply = JSON.parse(reply);
+      // Downloads the trace recorded by the module instance of the port
+      async saveTrace(port = 0) {
+          let file = '/trace.wbtr';
+          let reply = await this.request('traceSave', { file: file, port: port });
+
+          if (reply.error)
+              return;
 
-          if (this.reply.error)
-              this.print('request error ' + this.reply.error.code + ': ' + this.reply.error.message);
+          let data = this.ports[port].FS.readFile(file);
+          this.ports[port].FS.unlink(file);
 
-          this.finished = true;
+          let link = document.createElement('a');
+          link.href = URL.createObjectURL(new Blob([data]));
+          link.download = 'wb-serial-' + port + '-' + new Date().toISOString().replace(/[:.]/g, '-') + '.wbtr';
+          link.click();
+          URL.revokeObjectURL(link.href);
       },
 
-      setStatus(text) {
-          this.print(text);
+      // progress of the first instance is shown, other instances are prepared when their adapters are added
+      async warmUp(port) {
+          let start = performance.now();
+
+          while (true) {
+              let reply = await this.ports[port].request('init', {}, 'background');
+
+              // templates are prepared by the first device request then, the progress bar isn't left stuck
+              if (reply.error) {
+                  if (!port)
+                      this.initStatus.progress = 0;
+
+                  this.print('module for port ' + port + ' failed to initialize: ' + reply.error.message);
+                  return;
+              }
+
+              if (reply.result.total && !port)
+                  this.initStatus.progress = 100 * reply.result.done / reply.result.total;
+
+              if (reply.result.finished)
+                  break;
+          }
+
+          if (!port)
+              this.initStatus.progress = 100;
+
+          this.print('module for port ' + port + ' initialized in ' + Math.round(performance.now() - start) + ' ms');
       },
 
       print(text) {
@@ -55,62 +276,304 @@ window.Module =
       },
   };
 
+// Devices found on each serial adapter, kept in IndexedDB between visits
+class BusInventory {
+    static database = 'wb-device-editor';
+    static store = 'inventory';
+
+    async open() {
+        if (this.db)
+            return this.db;
+
+        this.db = await new Promise((resolve, reject) => {
+            let request = indexedDB.open(BusInventory.database, 1);
+            request.onupgradeneeded = () => request.result.createObjectStore(BusInventory.store);
+            request.onsuccess = () => resolve(request.result);
+            request.onerror = () => reject(request.error);
+        });
+
+        return this.db;
+    }
+
+    async load(portId) {
+        try {
+            let db = await this.open();
+
+            return await new Promise((resolve, reject) => {
+                let request = db.transaction(BusInventory.store).objectStore(BusInventory.store).get(portId);
+                request.onsuccess = () => resolve(request.result ?? new Array());
+                request.onerror = () => reject(request.error);
+            });
+        } catch (error) {
+            console.error('Can\'t load bus inventory: ', error);
+            return new Array();
+        }
+    }
+
+    async save(portId, devices) {
+        try {
+            let db = await this.open();
+            let transaction = db.transaction(BusInventory.store, 'readwrite');
+            transaction.objectStore(BusInventory.store).put(devices, portId);
+
+            await new Promise((resolve, reject) => {
+                transaction.oncomplete = resolve;
+                transaction.onerror = () => reject(transaction.error);
+            });
+        } catch (error) {
+            console.error('Can\'t save bus inventory: ', error);
+        }
+    }
+}
+
 class PortScan {
     baudRate = [115200, 57600, 38400, 19200, 9600, 4800, 2400, 1200];
+
+    // few devices use rates above 115200 and each of them makes the sweep longer by an eighth, so they are tried
+    // after the common rates only if ?highbaud=1 is added to the URL
+    highBaudRate = [230400, 460800, 921600];
+    highBaudRateEnabled = new URLSearchParams(window.location.search).get('highbaud') === '1';
     parity = ['N', 'E', 'O'];
-    step = 100 / this.baudRate.length / this.parity.length;
+    inventory = new BusInventory();
     progress = 0;
 
-    constructor(callback) {
+    // slave ids probed by one classic scan request
+    maxSlaveId = 247;
+    classicChunk = 16;
+
+    // Modbus default line settings, the classic scan probes them if the fast scan finds no devices
+    classicDefaultOptions = { baudRate: 9600, parity: 'N' };
+
+    // listen to the bus before the sweep and scan only the settings used by another master if it's found,
+    // add ?sniff=1 to the URL to enable it
+    sniffEnabled = new URLSearchParams(window.location.search).get('sniff') === '1';
+
+    // Settings other than the ones of the master also give valid frames now and then, by chance or by a frame read
+    // at a multiple of its baud rate. The traffic is taken as the master's only if it has a few frames and most
+    // of the received bytes belong to them.
+    sniffMinFrames = 2;
+    sniffMinScore = 0.5;
+
+    constructor(callback, port = 0) {
         this.callback = callback;
+        this.port = port;
     }
 
-    async request(start) {
+    async request(options, start) {
         let request =
           {
               command: 96,
               mode: start ? 'start' : 'next',
-              baud_rate: this.baudRate[this.baudRateIndex],
+              baud_rate: options.baudRate,
               data_bits: 8,
-              parity: this.parity[this.parityIndex],
+              parity: options.parity,
               stop_bits: 2,
+              port: this.port,
           };
 
-        return await Module.request('portScan', request);
+        return await Module.request('portScan', request, 'scan');
     }
 
-    async exec() {
-        let devices = new Array();
+    async scanOptions(options, devices, slaveIds = null) {
         let start = true;
 
-        this.baudRateIndex = 0;
+        this.options = options;
+        this.updateStatus();
+
+        while (true) {
+            let reply = await this.request(options, start);
+
+            if (!reply.result?.devices?.length)
+                break;
+
+            reply.result.devices.forEach((device) => devices.push(device));
+            this.count = devices.length;
+            start = false;
+        }
+
+        if (slaveIds)
+            await this.classicScan(options, devices, slaveIds);
+
+        this.progress += this.step;
+    }
+
+    // Probes slave ids for devices without the fast scan extension, all of them unless the list is given. Each request
+    // covers a part of the range to let other requests run between them.
+    async classicScan(options, devices, slaveIds = null) {
+        let ranges = new Array();
+
+        if (slaveIds)
+            slaveIds.forEach((slaveId) => ranges.push({ first: slaveId, count: 1 }));
+        else
+            for (let first = 1; first <= this.maxSlaveId; first += this.classicChunk)
+                ranges.push({ first: first, count: this.classicChunk });
+
+        for (let range of ranges) {
+            let reply = await Module.request('portScan', {
+                command: 3,
+                mode: 'classic',
+                baud_rate: options.baudRate,
+                data_bits: 8,
+                parity: options.parity,
+                stop_bits: 2,
+                first_slave_id: range.first,
+                slave_ids_count: range.count,
+                port: this.port,
+            }, 'scan');
+
+            (reply.result?.devices ?? []).forEach((device) => {
+                if (!devices.some((found) => this.isSameAddress(found.cfg, device.cfg)))
+                    devices.push(device);
+            });
+
+            this.count = devices.length;
+            this.updateStatus();
+        }
+    }
+
+    isSameAddress(a, b) {
+        return a.slave_id === b.slave_id && a.baud_rate === b.baud_rate && a.parity === b.parity;
+    }
+
+    // devices found by the classic scan have no serial number, they are told apart by their address
+    isSameDevice(a, b) {
+        return a.sn || b.sn ? a.sn === b.sn : this.isSameAddress(a.cfg, b.cfg);
+    }
+
+    // Listens to the bus at each of the options and takes the one where the most of the received bytes are valid
+    // frames. Returns the options with the traffic and slave ids seen in the frames, or null if no options have
+    // the traffic of another master.
+    async sniff(options) {
+        let best = null;
+
+        for (let item of options) {
+            this.options = item;
+            this.updateStatus();
+
+            let reply = await Module.request('portSniff', {
+                baud_rate: item.baudRate,
+                data_bits: 8,
+                parity: item.parity,
+                stop_bits: 2,
+                port: this.port,
+            }, 'scan');
+
+            let result = reply.result;
+
+            if (!result || result.frames < this.sniffMinFrames || result.score < this.sniffMinScore)
+                continue;
+
+            if (!best || result.score > best.score || (result.score === best.score && result.frames > best.frames))
+                best = { options: item, slaveIds: result.slave_ids, score: result.score, frames: result.frames };
+        }
+
+        return best;
+    }
+
+    // Warm scan checks line settings of devices found on this adapter before and falls back to the full sweep
+    // only if some of them weren't found. Classic scan additionally probes every slave id, it takes seconds per line
+    // setting, so only settings where the fast scan found devices are probed, or the Modbus default ones.
+    async exec(warm = false, classic = false) {
+        let devices = new Array();
+        let options = new Array();
+        let serial = Module.ports[this.port].serial;
+
+        if (serial.scanOptions)
+            options = serial.scanOptions.slice();
+        else
+            this.baudRate.concat(this.highBaudRateEnabled ? this.highBaudRate : [])
+                .forEach((baudRate) => this.parity.forEach((parity) => options.push({ baudRate, parity })));
+
+        await serial.select(false);
+
+        let portId = await serial.getId();
+        let known = warm ? await this.inventory.load(portId) : new Array();
+
+        // settings of known devices are checked even if the sweep doesn't include them
+        if (!serial.scanOptions) {
+            known.forEach((device) => {
+                let baudRate = device.cfg.baud_rate;
+                let parity = device.cfg.parity;
+
+                if (!options.some((item) => item.baudRate === baudRate && item.parity === parity))
+                    options.push({ baudRate, parity });
+            });
+        }
+
+        let knownOptions = options.filter((item) => known.some((device) => {
+            return device.cfg.baud_rate === item.baudRate && device.cfg.parity === item.parity;
+        }));
+
+        // part of the progress taken by the fast scan
+        let fastScanPart = classic ? 50 : 100;
+
         this.progress = 0;
         this.count = 0;
+        this.step = fastScanPart / (knownOptions.length || options.length);
 
-        while (this.baudRateIndex < this.baudRate.length) {
-            this.parityIndex = 0;
-            this.updateStatus();
+        // devices without the fast scan extension are probed by their slave ids
+        for (let item of knownOptions) {
+            let slaveIds = known.filter((device) => !device.sn && device.cfg.baud_rate === item.baudRate &&
+                                                    device.cfg.parity === item.parity)
+                               .map((device) => device.cfg.slave_id);
 
-            while (this.parityIndex < this.parity.length) {
-                let reply = await this.request(start);
+            await this.scanOptions(item, devices, slaveIds.length ? slaveIds : null);
+        }
 
-                if (reply.result?.devices?.length) {
-                    reply.result.devices.forEach((device) => devices.push(device));
-                    start = false;
-                    continue;
-                }
+        let missing = known.filter((device) => !devices.some((found) => this.isSameDevice(found, device)));
 
-                this.progress += this.step;
-                this.count += devices.length;
-                this.parityIndex++;
-                start = true;
+        if (!knownOptions.length || missing.length) {
+            let rest = options.filter((item) => !knownOptions.includes(item));
+            let found = devices.length;
+
+            let traffic = this.sniffEnabled && !serial.scanOptions ? await this.sniff(rest) : null;
+
+            this.step = (fastScanPart - this.progress) / rest.length;
+
+            // devices of a bus with another master answer at its line settings, they are probed by the slave ids
+            // it polls in addition to the fast scan
+            if (traffic) {
+                await this.scanOptions(traffic.options, devices, traffic.slaveIds);
+                rest = rest.filter((item) => item !== traffic.options);
+            }
+
+            // the traffic may come from devices which don't answer the scan, then all settings are swept
+            if (!traffic || devices.length === found) {
+                for (let item of rest)
+                    await this.scanOptions(item, devices);
             }
+        }
+
+        if (classic) {
+            let classicOptions = options.filter((item) => devices.some((device) => {
+                return device.cfg.baud_rate === item.baudRate && device.cfg.parity === item.parity;
+            }));
+
+            if (!classicOptions.length)
+                classicOptions.push(serial.scanOptions?.[0] ?? this.classicDefaultOptions);
 
-            this.baudRateIndex++;
-            start = true;
+            this.progress = fastScanPart;
+            this.step = (100 - this.progress) / classicOptions.length;
+
+            for (let item of classicOptions) {
+                this.options = item;
+                await this.classicScan(item, devices);
+                this.progress += this.step;
+            }
         }
 
+        this.progress = 100;
         this.updateStatus();
+
+        devices.forEach((device) => device.port = this.port);
+
+        await this.inventory.save(portId, devices.map((device) => ({
+            sn: device.sn,
+            cfg: device.cfg,
+            device_signature: device.device_signature,
+            fw: device.fw,
+        })));
+
         return { devices: devices };
     }
 
@@ -124,10 +587,102 @@ class PortScan {
         };
 
         if (this.progress < 100)
-            status.options = this.baudRate[this.progress ? this.baudRateIndex : 0] + ' 8' + this.parity[this.progress ? this.parityIndex : 0] + '2';
+            status.options = this.options.baudRate + ' 8' + this.options.parity + '2';
 
         this.callback(status);
     }
 }
 
 window.PortScan = PortScan;
+
+// Polls channels of a device in background. The module reads only due channels in one request and tells when the
+// next one is due, changed values formatted by the module are collected and delivered to the callback once per
+// animation frame.
+class ChannelMonitor {
+    // delay before the next poll after a failed one
+    retryDelay = 1000;
+
+    values = new Object();
+    errors = new Set();
+
+    // incremented on every start and stop, a reply of an older generation is dropped, so a poll awaited across
+    // a restart doesn't start a second poll loop
+    generation = 0;
+
+    constructor(callback) {
+        this.callback = callback;
+    }
+
+    // Starts monitoring of the device channels with optional intervals, all readable channels are monitored
+    // if the list is empty. Returns names of monitored channels.
+    async start(cfg, channels = []) {
+        await this.stop();
+
+        let generation = ++this.generation;
+        this.port = cfg.port ?? 0;
+
+        let request = { ...cfg, channels: channels };
+        let reply = await Module.request('monitorStart', request, 'interactive');
+
+        if (reply.error || generation !== this.generation)
+            return new Array();
+
+        this.running = true;
+        this.values = new Object();
+        this.errors = new Set();
+
+        if (reply.result.channels.length)
+            this.poll(generation);
+
+        return reply.result.channels;
+    }
+
+    async poll(generation) {
+        let reply = await Module.request('monitorPoll', { port: this.port }, 'background');
+
+        if (generation !== this.generation)
+            return;
+
+        if (reply.result) {
+            Object.assign(this.values, reply.result.values);
+            Object.keys(reply.result.values).forEach((name) => this.errors.delete(name));
+            reply.result.errors.forEach((name) => this.errors.add(name));
+            this.deliver();
+        }
+
+        this.timer = setTimeout(() => this.poll(generation), reply.result?.next ?? this.retryDelay);
+    }
+
+    deliver() {
+        if (this.frame)
+            return;
+
+        this.frame = requestAnimationFrame(() => {
+            this.frame = null;
+            this.callback({ values: { ...this.values }, errors: Array.from(this.errors) });
+        });
+    }
+
+    async stop() {
+        ++this.generation;
+
+        if (!this.running)
+            return;
+
+        this.running = false;
+        clearTimeout(this.timer);
+        cancelAnimationFrame(this.frame);
+        this.frame = null;
+
+        await Module.request('monitorStop', { port: this.port }, 'interactive');
+    }
+}
+
+window.ChannelMonitor = ChannelMonitor;
+
+// module instances are created by createModule defined in module.js
+let moduleScript = document.createElement('script');
+moduleScript.src = '/module.js';
+moduleScript.async = true;
+moduleScript.onload = () => Module.start();
+document.head.appendChild(moduleScript);
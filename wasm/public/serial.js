@@ -14,8 +14,29 @@ class SerialPort {
       ];
 
     options = new Object();
+    byteTime = 0;
+    written = 0;
+
+    // time given to a device to start replying when the module has no estimate for it, transfer time of the frames
+    // is added to it
+    replyDelay = 250;
+
+    // reply timeout used before it was scaled to the baud rate, kept as the least timeout on slow lines where
+    // devices tend to reply late
+    slowLineTimeout = 500;
+    slowBaudRate = 19200;
+
+    // time spent in serial operations, tells the Asyncify overhead apart from the I/O time
+    ioTime = 0;
+
+    // shortest idle time ending a frame, covers the latency timer of USB adapters
+    minFrameGap = 20;
+
     isOpen = false;
 
+    // errors of reading which don't close the port
+    static lineErrors = ['FramingError', 'ParityError', 'BreakError', 'BufferOverrunError'];
+
     constructor() {
         if (navigator.serial)
             return;
@@ -24,12 +45,6 @@ class SerialPort {
     }
 
     setOptions(baudRate, dataBits, parity, stopBits) {
-        switch (true) {
-            case baudRate < 4800: this.replyTimeout = 1000; break;
-            case baudRate < 38400: this.replyTimeout = 500; break;
-            default: this.replyTimeout = 250; break;
-        }
-
         switch (String.fromCharCode(parity)) {
             case 'E': this.options.parity = 'even'; break;
             case 'O': this.options.parity = 'odd'; break;
@@ -39,6 +54,16 @@ class SerialPort {
         this.options.baudRate = baudRate;
         this.options.dataBits = dataBits;
         this.options.stopBits = stopBits;
+
+        // start bit, data bits, parity bit and stop bits
+        this.byteTime = 1000 * (1 + dataBits + (this.options.parity === 'none' ? 0 : 1) + stopBits) / baudRate;
+    }
+
+    // reply timeout scaled to the baud rate, so slow lines get time to transfer the whole frame and fast ones
+    // don't wait longer than needed
+    getReplyTimeout(count) {
+        let timeout = this.replyDelay + Math.ceil((this.written + Math.min(count, 256)) * this.byteTime);
+        return this.options.baudRate <= this.slowBaudRate ? Math.max(timeout, this.slowLineTimeout) : timeout;
     }
 
     async select(force) {
@@ -48,6 +73,25 @@ class SerialPort {
         this.port = await navigator.serial.requestPort({ filters: this.filters });
     }
 
+    // Web Serial doesn't expose adapter serial numbers, so adapters are told apart by USB ids and identical ones by
+    // their order among the ports granted to the page, which the browser keeps while the adapters stay plugged in
+    async getId() {
+        let info = this.port?.getInfo() ?? {};
+        let id = (info.usbVendorId ?? 0) + ':' + (info.usbProductId ?? 0);
+
+        if (!this.port)
+            return id;
+
+        let identical = (await navigator.serial.getPorts()).filter((port) => {
+            let other = port.getInfo();
+            return other.usbVendorId === info.usbVendorId && other.usbProductId === info.usbProductId;
+        });
+
+        // the first adapter keeps the id without the index, which inventories were saved with before
+        let index = identical.indexOf(this.port);
+        return index > 0 ? id + ':' + index : id;
+    }
+
     async open() {
         if (this.isOpen)
             await this.close();
@@ -86,12 +130,35 @@ class SerialPort {
             return;
         }
 
+        this.written = data.length;
+
         const writer = this.port.writable.getWriter();
         await writer.write(data);
         writer.releaseLock();
     }
 
-    async read(count) {
+    async measure(operation) {
+        let start = performance.now();
+        let result = await operation();
+        this.ioTime += performance.now() - start;
+        return result;
+    }
+
+    // sends the request and reads its reply in one call from the module
+    async transact(data, count, timeout, frameGap) {
+        await this.write(data);
+        return await this.read(count, timeout, frameGap);
+    }
+
+    // collects bus traffic at the current options without sending anything
+    async listen(duration) {
+        await this.open();
+        return await this.read(Infinity, duration);
+    }
+
+    // Reads until the count of bytes is received or the timeout expires. With a frame gap the read also ends when
+    // the line stays idle for the gap after some data is received.
+    async read(count, timeout = this.getReplyTimeout(count), frameGap = 0) {
         if (!this.port || !this.port.readable) {
             console.error('Serial port is not open or not readable');
             return;
@@ -100,12 +167,42 @@ class SerialPort {
         const reader = this.port.readable.getReader();
         let data = new Uint8Array();
         let read = true;
+        let gapTimer;
+
+        // USB adapters deliver data in chunks, so the gap can't be shorter than their latency
+        frameGap = frameGap && Math.max(frameGap, this.minFrameGap);
+
+        function stop() {
+            if (read) {
+                read = false;
+                reader.cancel();
+            }
+        }
 
         async function receive() {
+            try {
+                await receiveFrames();
+            } catch (error) {
+                // Line errors come when the options differ from the ones of the bus, the data is garbage then, so
+                // nothing is taken as received. The port stays usable after them.
+                if (read) {
+                    if (SerialPort.lineErrors.includes(error.name))
+                        data = new Uint8Array();
+                    else
+                        console.error('Serial port read failed: ', error);
+
+                    read = false;
+                }
+            }
+
+            return data;
+        }
+
+        async function receiveFrames() {
             while (read) {
-                let { value } = await reader.read();
+                let { value, done } = await reader.read();
 
-                if (!read)
+                if (!read || done)
                     break;
 
                 let buffer = new Uint8Array(data.length + value.length);
@@ -113,28 +210,30 @@ class SerialPort {
                 buffer.set(value, data.length);
                 data = buffer;
 
-                if (data.length < count)
+                if (data.length < count) {
+                    if (frameGap) {
+                        clearTimeout(gapTimer);
+                        gapTimer = setTimeout(stop, frameGap);
+                    }
+
                     continue;
+                }
 
                 read = false;
             }
-
-            return data;
         }
 
         async function wait(timeout) {
             await new Promise((resolve) => setTimeout(resolve, timeout));
-
-            if (read) {
-                read = false;
-                reader.cancel();
-            }
-
+            stop();
             return data;
         }
 
-        let result = await Promise.race([receive(), wait(this.replyTimeout)]);
-        reader.releaseLock();
-        return result;
+        try {
+            return await Promise.race([receive(), wait(timeout)]);
+        } finally {
+            clearTimeout(gapTimer);
+            reader.releaseLock();
+        }
     }
 }
@@ -0,0 +1,146 @@
+// Port tunneling frames over a WebSocket to an Ethernet to RS-485 gateway or a controller TCP bridge. It has the
+// same interface as SerialPort, so the module uses it the same way. Line settings are configured in the gateway.
+class WebSocketPort {
+    options = new Object();
+    written = 0;
+    ioTime = 0;
+
+    // time given to the gateway to reply when the module has no estimate for it
+    replyDelay = 1000;
+
+    // shortest idle time ending a frame, covers network jitter
+    minFrameGap = 20;
+
+    // the gateway talks to devices at its own line settings, so they are scanned once
+    scanOptions = [{ baudRate: 9600, parity: 'N' }];
+
+    constructor(url) {
+        this.url = url;
+        this.buffer = new Uint8Array();
+    }
+
+    setOptions(baudRate, dataBits, parity, stopBits) {
+        this.options = { baudRate, dataBits, parity: String.fromCharCode(parity), stopBits };
+    }
+
+    async select(force) {
+        if (force)
+            await this.close();
+
+        await this.open();
+    }
+
+    async getId() {
+        return this.url;
+    }
+
+    async open() {
+        if (this.socket?.readyState === WebSocket.OPEN)
+            return;
+
+        try {
+            this.socket = await new Promise((resolve, reject) => {
+                let socket = new WebSocket(this.url);
+                socket.binaryType = 'arraybuffer';
+                socket.onopen = () => resolve(socket);
+                socket.onerror = () => reject(new Error('connection to ' + this.url + ' failed'));
+            });
+        } catch (error) {
+            console.error('Can\'t open WebSocket: ', error);
+            delete this.socket;
+            return;
+        }
+
+        this.socket.onmessage = (event) => {
+            let value = new Uint8Array(event.data);
+            let buffer = new Uint8Array(this.buffer.length + value.length);
+            buffer.set(this.buffer, 0);
+            buffer.set(value, this.buffer.length);
+            this.buffer = buffer;
+
+            if (this.onData)
+                this.onData();
+        };
+    }
+
+    async close() {
+        if (!this.socket)
+            return;
+
+        this.socket.close();
+        delete this.socket;
+    }
+
+    getReplyTimeout(count) {
+        return this.replyDelay;
+    }
+
+    async measure(operation) {
+        let start = performance.now();
+        let result = await operation();
+        this.ioTime += performance.now() - start;
+        return result;
+    }
+
+    async write(data) {
+        await this.open();
+
+        if (!this.socket) {
+            console.error('WebSocket is not open');
+            return;
+        }
+
+        // replies left from timed out requests are dropped
+        this.buffer = new Uint8Array();
+        this.written = data.length;
+        this.socket.send(data);
+    }
+
+    async transact(data, count, timeout, frameGap) {
+        await this.write(data);
+        return await this.read(count, timeout, frameGap);
+    }
+
+    async listen(duration) {
+        await this.open();
+        return await this.read(Infinity, duration);
+    }
+
+    // Reads until the count of bytes is received or the timeout expires, with a frame gap the read also ends when
+    // nothing is received for the gap. Data after the count is kept for the next read, so replies to pipelined
+    // requests aren't lost.
+    read(count, timeout = this.getReplyTimeout(count), frameGap = 0) {
+        frameGap = frameGap && Math.max(frameGap, this.minFrameGap);
+
+        return new Promise((resolve) => {
+            let gapTimer;
+            let timer;
+
+            let finish = () => {
+                clearTimeout(timer);
+                clearTimeout(gapTimer);
+                this.onData = null;
+
+                let data = this.buffer.slice(0, Math.min(count, this.buffer.length));
+                this.buffer = this.buffer.slice(data.length);
+                resolve(data);
+            };
+
+            this.onData = () => {
+                if (this.buffer.length >= count) {
+                    finish();
+                } else if (frameGap) {
+                    clearTimeout(gapTimer);
+                    gapTimer = setTimeout(finish, frameGap);
+                }
+            };
+
+            timer = setTimeout(finish, timeout);
+
+            if (this.buffer.length)
+                this.onData();
+        });
+    }
+}
+
+window.WebSocketPort = WebSocketPort;
@@ -1,5 +1,5 @@
 import { observer } from 'mobx-react-lite';
-import { useCallback, useEffect, useState } from 'react';
+import { useCallback, useEffect, useRef, useState } from 'react';
 import { useTranslation } from 'react-i18next';
 import { Button } from '@/components/button';
 import { Dropdown, type Option } from '@/components/dropdown';
@@ -11,40 +11,82 @@ import { setReactLocale } from '~/react-directives/locale';
 import { FirmwareVersionPanel } from '@/pages/settings/device-manager/components/embedded-software-panel/embedded-software-panel';
 import { DeviceTabStore, DeviceTypesStore } from '@/stores/device-manager/';
 import { DeviceSettingsEditor } from '@/pages/settings/device-manager/components/device-settings-editor/device-settings-editor';
-import type { Device, DeviceSettingsWasmProps } from './types';
+import type {
+  Device,
+  DeviceSettingsWasmProps,
+  FirmwareUpdateProgress,
+  LoadConfigProgress,
+  MonitorUpdate,
+} from './types';
 import './styles.css';
 
 export const DeviceSettingsWasm = observer(({
   scan,
   isReady,
   loadConfig,
+  updateFirmware,
+  startMonitor,
+  stopMonitor,
+  saveTrace,
   portScan,
+  initStatus,
+  onFirstScreen,
   selectPort,
+  addPort,
+  addGateway,
   getSchema,
   getDeviceTypes,
+  matchDeviceTypes,
   save,
 }: DeviceSettingsWasmProps) => {
   const { t } = useTranslation();
   const [language, setLanguage] = useState(localStorage.getItem('language') || 'en');
   const [devices, setDevices] = useState<Device[]>([]);
+  const [deviceTypes, setDeviceTypes] = useState<Map<string, string[]>>(new Map());
   const [tabstore, setTabstore] = useState(null);
   const [selectedDevice, setSelectedDevice] = useState(null);
   const [isConfigLoading, setIsConfigLoading] = useState(false);
+  const [configProgress, setConfigProgress] = useState<LoadConfigProgress>(null);
+  const [loadedParameters, setLoadedParameters] = useState<Record<string, any>>({});
   const [configDeviceTypesStore, setConfigDeviceTypesStore] = useState(null);
+  const [firmwareProgress, setFirmwareProgress] = useState<FirmwareUpdateProgress>(null);
+  const firmwareInput = useRef<HTMLInputElement>(null);
+  const [monitorChannels, setMonitorChannels] = useState<string[]>(null);
+  const [monitorUpdate, setMonitorUpdate] = useState<MonitorUpdate>(null);
   const { activeTab } = useTabs({
     defaultTab: selectedDevice,
     items: devices,
   });
 
+  // devices on different adapters may have the same slave id
+  const getDeviceKey = (device: Device) => `${device.port ?? 0}:${device.cfg.slave_id}`;
+
+  const handleStopMonitor = () => {
+    setMonitorChannels(null);
+    setMonitorUpdate(null);
+    stopMonitor();
+  };
+
   const reset = () => {
+    handleStopMonitor();
     setDevices([]);
+    setDeviceTypes(new Map());
     setTabstore(null);
   };
 
+  // all scanned devices are matched in one module request, the store lookup is a fallback
+  const findDeviceTypes = (device: Device, types = deviceTypes, deviceTypesStore = configDeviceTypesStore) => {
+    return types.get(getDeviceKey(device))
+      || deviceTypesStore.findNotDeprecatedDeviceTypes(device.device_signature, device.fw?.version);
+  };
+
   const configDeviceTypes = async () => {
     return getDeviceTypes(language).then((res) => {
       const deviceTypesStore = new DeviceTypesStore(getSchema);
       deviceTypesStore.setDeviceTypeGroups(res);
+      if (!configDeviceTypesStore) {
+        onFirstScreen?.();
+      }
       setConfigDeviceTypesStore(deviceTypesStore);
       return deviceTypesStore;
     });
@@ -63,33 +105,47 @@ export const DeviceSettingsWasm = observer(({
     });
   }, [isReady, language]);
 
-  const handleScan = async () => {
+  const handleScan = async (warm = false, classic = false) => {
     reset();
-    const res = await scan();
+    const res = await scan(warm, classic);
     const firstDevice = res.at(0);
-    setSelectedDevice(firstDevice?.cfg.slave_id);
+    const matched = await matchDeviceTypes(res)
+      .then((types) => new Map(res.map((device, i) => [getDeviceKey(device), types[i]])))
+      .catch(() => new Map<string, string[]>());
+    setSelectedDevice(firstDevice && getDeviceKey(firstDevice));
 
+    setDeviceTypes(matched);
     setDevices(res);
 
-    loadDeviceSettings(firstDevice, configDeviceTypesStore);
+    loadDeviceSettings(firstDevice, configDeviceTypesStore, matched);
   };
 
-  const loadDeviceSettings = useCallback(async (device: Device, deviceTypesStore = configDeviceTypesStore) => {
-    const deviceTypes = deviceTypesStore.findNotDeprecatedDeviceTypes(
-      device.device_signature,
-      device.fw?.version
-    );
+  const loadDeviceSettings = useCallback(async (
+    device: Device,
+    deviceTypesStore = configDeviceTypesStore,
+    matched = deviceTypes
+  ) => {
+    const deviceTypes = findDeviceTypes(device, matched, deviceTypesStore);
 
+    handleStopMonitor();
     setIsConfigLoading(true);
+    setConfigProgress(null);
+    setLoadedParameters({});
+
+    // values of every read group are shown while the rest of groups are read
+    const onProgress = (progress: LoadConfigProgress) => {
+      setConfigProgress(progress);
+      setLoadedParameters((parameters) => ({ ...parameters, ...progress.result?.parameters }));
+    };
 
     const initialData = { slave_id: String(device.cfg.slave_id) };
-    const cfg = { device_type: deviceTypes.at(0), ...device.cfg };
+    const cfg = { device_type: deviceTypes.at(0), fw: device.fw?.version, port: device.port, ...device.cfg };
     const store = new DeviceTabStore(
       initialData,
       deviceTypes.at(0),
       deviceTypesStore,
       { GetFirmwareInfo: () => ({ fw: device.fw?.version }), hasMethod: () => true },
-      { LoadConfig: () => loadConfig(cfg).then(res => res.result) }
+      { LoadConfig: () => loadConfig(cfg, onProgress).then(res => res.result) }
     );
     await store.loadContent(device.cfg);
     store.setDeviceType(device.device_signature, cfg);
@@ -97,15 +153,50 @@ export const DeviceSettingsWasm = observer(({
 
     setTabstore(store);
     setIsConfigLoading(false);
-  }, [configDeviceTypesStore]);
+  }, [configDeviceTypesStore, deviceTypes]);
 
-  const getDevice = (slaveId: number = selectedDevice) => devices.find((device) => device.cfg.slave_id === slaveId);
+  // gateway is set by its WebSocket URL, the protocol is asked separately
+  const handleAddGateway = () => {
+    const url = window.prompt(t('wasm.labels.gateway-url'), 'ws://');
+    if (url) {
+      addGateway(url, window.confirm(t('wasm.labels.gateway-modbus-tcp')));
+    }
+  };
+
+  const getDevice = (key: string = selectedDevice) => devices.find((device) => getDeviceKey(device) === key);
+
+  // a device stays in the bootloader after a failed update, so a retry writes the image without rebooting it
+  const handleFirmwareUpdate = async (file: File, inBootloader = false) => {
+    const device = getDevice();
+    setFirmwareProgress({ written: 0, total: file.size, speed: 0 });
+    const cfg = { port: device.port, ...device.cfg, in_bootloader: inBootloader };
+    const res = await updateFirmware(cfg, file, setFirmwareProgress);
+    setFirmwareProgress(null);
+
+    if (!res.error) {
+      loadDeviceSettings(device);
+    } else if (window.confirm(t('wasm.labels.firmware-retry', { error: res.error.message }))) {
+      handleFirmwareUpdate(file, true);
+    }
+  };
+
+  // values of all readable channels of the template are polled in background while the table is shown
+  const handleStartMonitor = async () => {
+    const device = getDevice();
+    const cfg = { device_type: tabstore.deviceType, port: device.port, ...device.cfg };
+    setMonitorUpdate({ values: {}, errors: [] });
+    setMonitorChannels(await startMonitor(cfg, setMonitorUpdate));
+  };
 
   const handleSave = () => {
     const data = {
       device_type: tabstore.deviceType,
+      fw: getDevice().fw?.version,
+      port: getDevice().port,
       ...getDevice().cfg,
       parameters: tabstore.editedData,
+      // parameters are settings, so ones the device already holds aren't written again
+      skip_unchanged: true,
     };
     delete data.parameters.slave_id;
 
@@ -118,7 +209,12 @@ export const DeviceSettingsWasm = observer(({
       actions={
         <>
           <Button label={t('wasm.buttons.select')} variant="secondary" onClick={selectPort} />
-          <Button label={t('wasm.buttons.scan')} onClick={handleScan} />
+          <Button label={t('wasm.buttons.add-port')} variant="secondary" onClick={addPort} />
+          <Button label={t('wasm.buttons.add-gateway')} variant="secondary" onClick={handleAddGateway} />
+          <Button label={t('wasm.buttons.scan')} onClick={() => handleScan()} />
+          <Button label={t('wasm.buttons.rescan')} variant="secondary" onClick={() => handleScan(true)} />
+          <Button label={t('wasm.buttons.classic-scan')} variant="secondary" onClick={() => handleScan(false, true)} />
+          {saveTrace && <Button label={t('wasm.buttons.save-trace')} variant="secondary" onClick={saveTrace} />}
           <Button label={t('wasm.buttons.save')} disabled={!devices.length} variant="success" onClick={handleSave} />
         </>
       }
@@ -144,6 +240,9 @@ export const DeviceSettingsWasm = observer(({
       }
       hasRights
     >
+      {initStatus.progress !== 0 && initStatus.progress < 100 && (
+        <Progress value={initStatus.progress} caption={initStatus.progress.toFixed() + '%'} />
+      )}
       {portScan.progress !== 0 && portScan.progress < 100 && (
         <Progress value={portScan.progress} caption={portScan.progress.toFixed() + '%'} />
       )}
@@ -151,9 +250,12 @@ export const DeviceSettingsWasm = observer(({
         <aside className="deviceSettingsWasm-aside">
           {!!devices.length && (
             <Tabs
-              items={devices.map((device) => ({ id: device.cfg.slave_id, label: `${device.cfg.slave_id} ${configDeviceTypesStore.findNotDeprecatedDeviceTypes(device.device_signature, device.fw?.version).at(0)}` }))}
+              items={devices.map((device) => ({
+                id: getDeviceKey(device),
+                label: `${device.port ? `${device.port + 1}/` : ''}${device.cfg.slave_id} ${findDeviceTypes(device).at(0)}`,
+              }))}
               activeTab={activeTab}
-              onTabChange={(id: number) => {
+              onTabChange={(id: string) => {
                 const device = getDevice(id);
                 setSelectedDevice(id);
                 loadDeviceSettings(device);
@@ -164,12 +266,84 @@ export const DeviceSettingsWasm = observer(({
         </aside>
         <section className="deviceSettingsWasm-content">
           {isConfigLoading ? (
-            <div className="deviceSettingsWasm-loaderWrapper"><Loader caption={t('device-manager.labels.reading-parameters')} /></div>
+            <div className="deviceSettingsWasm-loaderWrapper">
+              <Loader
+                caption={configProgress
+                  ? `${t('device-manager.labels.reading-parameters')} ${configProgress.index + 1}/${configProgress.count}`
+                  : t('device-manager.labels.reading-parameters')}
+              />
+              {!!Object.keys(loadedParameters).length && (
+                <table className="table table-condensed deviceSettingsWasm-monitor">
+                  <thead>
+                    <tr>
+                      <th>{t('wasm.labels.parameter')}</th>
+                      <th>{t('wasm.labels.value')}</th>
+                    </tr>
+                  </thead>
+                  <tbody>
+                    {Object.entries(loadedParameters).map(([name, value]) => (
+                      <tr key={name}>
+                        <td>{name}</td>
+                        <td>{String(value)}</td>
+                      </tr>
+                    ))}
+                  </tbody>
+                </table>
+              )}
+            </div>
           ) : (
             tabstore && (
               <>
                 <h3 className="deviceSettingsWasm-title">{tabstore.name}</h3>
                 <FirmwareVersionPanel firmwareVersion={getDevice().fw?.version} />
+                <input
+                  ref={firmwareInput}
+                  type="file"
+                  accept=".wbfw"
+                  hidden
+                  onChange={(event) => {
+                    const file = event.target.files?.[0];
+                    event.target.value = '';
+                    if (file) {
+                      handleFirmwareUpdate(file);
+                    }
+                  }}
+                />
+                {firmwareProgress ? (
+                  <Progress
+                    value={100 * firmwareProgress.written / firmwareProgress.total}
+                    caption={`${Math.round(firmwareProgress.speed)} B/s`}
+                  />
+                ) : (
+                  <Button
+                    label={t('wasm.buttons.update-firmware')}
+                    variant="secondary"
+                    onClick={() => firmwareInput.current?.click()}
+                  />
+                )}
+                {monitorChannels ? (
+                  <>
+                    <Button label={t('wasm.buttons.stop-monitor')} variant="secondary" onClick={handleStopMonitor} />
+                    <table className="table table-condensed deviceSettingsWasm-monitor">
+                      <thead>
+                        <tr>
+                          <th>{t('wasm.labels.channel')}</th>
+                          <th>{t('wasm.labels.value')}</th>
+                        </tr>
+                      </thead>
+                      <tbody>
+                        {monitorChannels.map((name) => (
+                          <tr key={name} className={monitorUpdate?.errors.includes(name) ? 'danger' : undefined}>
+                            <td>{name}</td>
+                            <td>{monitorUpdate?.values[name] ?? '—'}</td>
+                          </tr>
+                        ))}
+                      </tbody>
+                    </table>
+                  </>
+                ) : (
+                  <Button label={t('wasm.buttons.monitor')} variant="secondary" onClick={handleStartMonitor} />
+                )}
                 <DeviceSettingsEditor
                   store={tabstore.schemaStore}
                   translator={tabstore.schemaStore.schemaTranslator}
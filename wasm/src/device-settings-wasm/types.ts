@@ -1,13 +1,24 @@
 export interface DeviceSettingsWasmProps {
-  scan: () => Promise<Device[]>;
+  scan: (_warm?: boolean, _classic?: boolean) => Promise<Device[]>;
   isReady: Promise<void>;
   selectPort:() => Promise<void>;
+  addPort: () => Promise<void>;
+  addGateway: (_url: string, _modbusTcp: boolean) => Promise<void>;
   portScan: {
     progress: number;
   }
-  loadConfig: (_data: any) => Promise<any>;
+  initStatus: {
+    progress: number;
+  };
+  onFirstScreen?: () => void;
+  loadConfig: (_data: any, _onProgress?: (_progress: LoadConfigProgress) => void) => Promise<any>;
+  updateFirmware: (_cfg: any, _file: File, _onProgress: (_progress: FirmwareUpdateProgress) => void) => Promise<any>;
+  startMonitor: (_cfg: any, _onUpdate: (_update: MonitorUpdate) => void) => Promise<string[]>;
+  stopMonitor: () => Promise<void>;
+  saveTrace?: () => Promise<void>;
   getSchema: (_deviceType: string) => Promise<any>;
   getDeviceTypes: (_lang: string) => Promise<any>;
+  matchDeviceTypes: (_devices: Device[]) => Promise<string[][]>;
   save: (_data: any) => Promise<void>;
 }
 
@@ -25,4 +36,24 @@ export interface Device {
   },
   fw_signature: string;
   sn: string;
+  port?: number;
+}
+
+export interface LoadConfigProgress {
+  group: string;
+  index: number;
+  count: number;
+  result: any;
+}
+
+export interface FirmwareUpdateProgress {
+  written: number;
+  total: number;
+  speed: number;
+}
+
+// values are formatted by the module the same way as values of MQTT controls of wb-mqtt-serial
+export interface MonitorUpdate {
+  values: Record<string, string>;
+  errors: string[];
 }
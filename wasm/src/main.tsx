@@ -3,7 +3,7 @@ import { configure, makeObservable, observable } from 'mobx';
 import { createRoot } from 'react-dom/client';
 import { initReactI18next } from 'react-i18next';
 import { DeviceSettingsWasm } from './device-settings-wasm';
-import type { Device } from './device-settings-wasm/types';
+import type { Device, MonitorUpdate } from './device-settings-wasm/types';
 import engLocale from '~/i18n/react/locales/en/translations.json';
 import engModuleLocale from './i18n/en/translations.json';
 import ruModuleLocale from './i18n/ru/translations.json';
@@ -40,41 +40,162 @@ i18n.use(initReactI18next).init({
 i18n.languages = ['en', 'ru'];
 
 declare class PortScan {
-  exec(): Promise<{ devices: any[] }>;
+  constructor(callback?: (status: any) => void, port?: number);
+  exec(warm?: boolean, classic?: boolean): Promise<{ devices: any[] }>;
   progress: number;
 }
 
+declare class ChannelMonitor {
+  constructor(callback: (update: MonitorUpdate) => void);
+  start(cfg: any, channels?: { name: string; interval?: number }[]): Promise<string[]>;
+  stop(): Promise<void>;
+}
+
+interface SerialPort {
+  select: (force: boolean) => Promise<any>;
+}
+
 declare const Module: {
-  request: (method: string, params: any) => Promise<any>;
-  serial: {
-    select: (auto: boolean) => Promise<any>;
+  request: (
+    method: string,
+    params: any,
+    priority?: 'interactive' | 'background' | 'scan',
+    onProgress?: (progress: any) => void
+  ) => Promise<any>;
+  print: (text: string) => void;
+  serial: SerialPort;
+  ports: {
+    serial: SerialPort;
+    FS: {
+      writeFile: (path: string, data: Uint8Array) => void;
+    };
+  }[];
+  addPort: (transport?: 'serial' | 'rtu-over-tcp' | 'modbus-tcp', url?: string, select?: boolean) => Promise<number>;
+  isReady: Promise<void>;
+  initStatus: {
+    progress: number;
   };
-  isReady: Promise<void>
+  warmUpEnabled: boolean;
+  traceEnabled: boolean;
+  saveTrace: (port?: number) => Promise<void>;
 };
-const portScan = new PortScan();
+const createPortScan = (port: number) => {
+  return makeObservable(new PortScan(null, port), {
+    progress: observable,
+  });
+};
+
+// every serial adapter is scanned by its own module instance, so adapters are scanned concurrently
+const portScans = observable.array([createPortScan(0)], { deep: false });
+
+const portScan = observable({
+  get progress() {
+    return portScans.reduce((sum, item) => sum + item.progress, 0) / portScans.length;
+  },
+});
 
-makeObservable(portScan, {
+makeObservable(Module.initStatus, {
   progress: observable,
 });
 
+const onFirstScreen = () => {
+  Module.print(`first usable screen in ${Math.round(performance.now())} ms, warm-up ${Module.warmUpEnabled ? 'on' : 'off'}`);
+};
+
 const selectPort = async () => {
   return Module.serial.select(true);
 };
 
-const scan = async (): Promise<Device[]> => {
-  return portScan.exec().then(({ devices }) => devices);
+const addPort = async () => {
+  const port = await Module.addPort('serial', null, true);
+  portScans.push(createPortScan(port));
+};
+
+const addGateway = async (url: string, modbusTcp: boolean) => {
+  const port = await Module.addPort(modbusTcp ? 'modbus-tcp' : 'rtu-over-tcp', url, true);
+  portScans.push(createPortScan(port));
+};
+
+const scan = async (warm = false, classic = false): Promise<Device[]> => {
+  const results = await Promise.all(portScans.map((item) => item.exec(warm, classic)));
+  return results.flatMap(({ devices }) => devices);
 };
 
-const loadConfig = async (cfg) => {
-  return Module.request('deviceLoadConfig', cfg);
+const loadConfig = async (cfg, onProgress?: (progress: any) => void) => {
+  return Module.request('deviceLoadConfig', { ...cfg, stream: !!onProgress }, 'interactive', onProgress);
+};
+
+// the image is passed to the module instance of the device port through its file system
+const updateFirmware = async (cfg, file: File, onProgress: (progress: any) => void) => {
+  const path = `/firmware-${Date.now()}.wbfw`;
+  Module.ports[cfg.port ?? 0].FS.writeFile(path, new Uint8Array(await file.arrayBuffer()));
+  return Module.request('firmwareUpdate', { ...cfg, file: path }, 'interactive', onProgress);
+};
+
+// one device is monitored at a time, its channel values are delivered in batches
+let monitor: ChannelMonitor = null;
+
+const startMonitor = async (cfg, onUpdate: (update: MonitorUpdate) => void) => {
+  await monitor?.stop();
+  monitor = new ChannelMonitor(onUpdate);
+  return monitor.start(cfg);
+};
+
+const stopMonitor = async () => {
+  await monitor?.stop();
+  monitor = null;
+};
+
+// traces of all ports are saved for a bug report
+const saveTrace = async () => {
+  for (let port = 0; port < Module.ports.length; port++) {
+    await Module.saveTrace(port);
+  }
 };
 
 const configGetDeviceTypes = async (lang: string) => {
   return Module.request('configGetDeviceTypes', { lang }).then((res) => res.result);
 };
 
+let commonSchema: Promise<any> = null;
+
+// definitions shared by all device schemas are requested once and added back to every schema,
+// a failed request isn't kept, so the next schema requests them again
+const getCommonSchema = async () => {
+  if (!commonSchema) {
+    commonSchema = Module.request('configGetCommonSchema', {}).then((res) => {
+      if (res.error || !res.result) {
+        throw new Error(res.error?.message || 'common schema is empty');
+      }
+      return res.result;
+    });
+    commonSchema.catch(() => {
+      commonSchema = null;
+    });
+  }
+  return commonSchema;
+};
+
 const configGetSchema = async (deviceType: string) => {
-  return Module.request('configGetSchema', { type: deviceType }).then((res) => res.result);
+  // without common definitions the module sends the full schema
+  const common = await getCommonSchema().catch(() => null);
+  const schema = await Module.request('configGetSchema', { type: deviceType, common_version: common?.version })
+    .then((res) => res.result);
+
+  if (schema?.$common) {
+    schema.definitions = schema.definitions || {};
+    schema.$common.definitions.forEach((name: string) => {
+      schema.definitions[name] = common.definitions[name];
+    });
+    delete schema.$common;
+  }
+
+  return schema;
+};
+
+const matchDeviceTypes = async (devices: Device[]): Promise<string[][]> => {
+  const request = devices.map((device) => ({ device_signature: device.device_signature, fw: device.fw?.version }));
+  return Module.request('configMatchDeviceTypes', { devices: request }).then((res) => res.result);
 };
 
 const save = async (data: any) => {
@@ -87,9 +208,18 @@ createRoot(document.querySelector('#root')).render(
     scan={scan}
     save={save}
     portScan={portScan}
+    initStatus={Module.initStatus}
+    onFirstScreen={onFirstScreen}
     selectPort={selectPort}
+    addPort={addPort}
+    addGateway={addGateway}
     loadConfig={loadConfig}
+    updateFirmware={updateFirmware}
+    startMonitor={startMonitor}
+    stopMonitor={stopMonitor}
+    saveTrace={Module.traceEnabled ? saveTrace : undefined}
     getSchema={configGetSchema}
     getDeviceTypes={configGetDeviceTypes}
+    matchDeviceTypes={matchDeviceTypes}
   />
 );
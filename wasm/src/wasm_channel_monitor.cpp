@@ -0,0 +1,203 @@
+#include "wasm_channel_monitor.h"
+#include "log.h"
+#include "modbus_ext_common.h"
+
+#include <list>
+
+#define LOG(logger) logger.Log() << "[wasm monitor] "
+
+using namespace std::chrono;
+using namespace std::chrono_literals;
+
+namespace
+{
+    // events are read often to get changes quickly, the same period as in wb-mqtt-serial
+    const auto EVENTS_INTERVAL = 50ms;
+
+    const std::map<std::string, uint8_t> FUNCTIONS = {
+        {"coil", 1},
+        {"discrete", 2},
+        {"holding", 3},
+        {"input", 4},
+    };
+
+    // Address is a number or a string with the register address and optional bit offset and width like "0x10:4",
+    // only the register address is taken. Returns false if the address isn't a number.
+    bool GetRegisterAddress(const Json::Value& value, uint16_t& address)
+    {
+        if (value.isIntegral()) {
+            if (!value.isUInt() || value.asUInt() > 0xFFFF) {
+                return false;
+            }
+            address = value.asUInt();
+            return true;
+        }
+
+        auto text = value.asString();
+        char* end = nullptr;
+        auto result = std::strtoul(text.c_str(), &end, 0);
+
+        if (end == text.c_str() || (*end && *end != ':') || result > 0xFFFF) {
+            return false;
+        }
+
+        address = result;
+        return true;
+    }
+
+    steady_clock::time_point GetNow()
+    {
+        return steady_clock::now();
+    }
+}
+
+TChannelMonitor::TChannelMonitor(PSerialDevice device,
+                                 const TDeviceProtocolParams& params,
+                                 const Json::Value& deviceTemplate,
+                                 const Json::Value& channels,
+                                 const milliseconds& defaultInterval)
+    : Device(device)
+{
+    std::map<std::string, milliseconds> selected;
+
+    for (const auto& channel: channels) {
+        selected[channel["name"].asString()] = milliseconds(channel.get("interval", 0).asInt());
+    }
+
+    for (const auto& item: deviceTemplate["channels"]) {
+        auto name = item["name"].asString();
+        auto interval = selected.find(name);
+
+        // channels of subdevices and composite channels have no register
+        if ((!selected.empty() && interval == selected.end()) || !item.isMember("address")) {
+            continue;
+        }
+
+        TChannel channel;
+        channel.Name = name;
+
+        PRegisterConfig config;
+
+        try {
+            config = LoadRegisterConfig(item,
+                                        params.factory->GetRegisterTypes(),
+                                        "channel " + name,
+                                        *params.factory,
+                                        params.factory->GetBaseRegisterAddress(),
+                                        0)
+                         .RegisterConfig;
+
+            // events are disabled by register type and address, channels without them are polled anyway
+            auto function = FUNCTIONS.find(item.get("reg_type", "holding").asString());
+
+            if (function != FUNCTIONS.end() && GetRegisterAddress(item["address"], channel.Address)) {
+                channel.Function = function->second;
+            }
+        } catch (const std::exception& e) {
+            LOG(Warn) << "channel " << name << " isn't monitored: " << e.what();
+            continue;
+        }
+
+        if (interval != selected.end() && interval->second.count()) {
+            config->ReadPeriod = interval->second;
+        } else if (!config->ReadPeriod) {
+            config->ReadPeriod = defaultInterval;
+        }
+
+        ChannelIndexes[Device->AddRegister(config)] = Channels.size();
+        Channels.push_back(channel);
+    }
+
+    std::list<PSerialDevice> devices{Device};
+    Reader = std::make_unique<TSerialClientRegisterAndEventsReader>(devices, EVENTS_INTERVAL, GetNow);
+    AccessHandler = std::make_unique<TSerialClientDeviceAccessHandler>(Reader->GetEventsReader());
+}
+
+std::vector<std::string> TChannelMonitor::GetChannelNames() const
+{
+    std::vector<std::string> names;
+
+    for (const auto& channel: Channels) {
+        names.push_back(channel.Name);
+    }
+
+    return names;
+}
+
+Json::Value TChannelMonitor::Poll(TPort& port, const milliseconds& budget)
+{
+    Json::Value result;
+    result["values"] = Json::Value(Json::objectValue);
+    result["errors"] = Json::Value(Json::arrayValue);
+
+    util::TSpentTimeMeter spentTime(GetNow);
+    spentTime.Start();
+
+    Reader->OpenPortCycle(port, spentTime, budget, true, *AccessHandler, [this, &result](PRegister reg) {
+        OnRegister(reg, result);
+    });
+
+    return result;
+}
+
+// Values are compared as formatted, so a register read again with the same value isn't sent to the page
+void TChannelMonitor::OnRegister(PRegister reg, Json::Value& result)
+{
+    auto index = ChannelIndexes.find(reg);
+
+    if (index == ChannelIndexes.end()) {
+        return;
+    }
+
+    auto& channel = Channels[index->second];
+
+    if (reg->GetErrorState().test(TRegister::ReadError) || reg->GetAvailable() == TRegisterAvailability::UNAVAILABLE) {
+        channel.Error = true;
+        result["errors"].append(channel.Name);
+        return;
+    }
+
+    auto value = ConvertFromRawValue(*reg->GetConfig(), reg->GetValue());
+
+    if (value != channel.Value || channel.Error) {
+        channel.Value = value;
+        channel.Error = false;
+        result["values"][channel.Name] = value;
+    }
+}
+
+void TChannelMonitor::DisableEvents(TPort& port)
+{
+    if (!Reader->GetEventsReader()->HasDevicesWithEnabledEvents()) {
+        return;
+    }
+
+    const auto& slaveId = Device->DeviceConfig()->SlaveId;
+
+    try {
+        ModbusExt::TEventsEnabler enabler(std::stoul(slaveId, nullptr, 0), port, [](auto&&...) {});
+
+        for (const auto& channel: Channels) {
+            if (channel.Function) {
+                enabler.AddRegister(channel.Address,
+                                    static_cast<ModbusExt::TEventType>(channel.Function),
+                                    ModbusExt::TEventPriority::DISABLE);
+            }
+        }
+
+        enabler.SendRequests();
+    } catch (const std::exception& e) {
+        LOG(Warn) << "events of slave id " << slaveId << " aren't disabled: " << e.what();
+    }
+}
+
+milliseconds TChannelMonitor::GetNextPollDelay() const
+{
+    if (Channels.empty()) {
+        return milliseconds::max();
+    }
+
+    auto now = GetNow();
+    auto deadline = Reader->GetDeadline(now);
+    return deadline > now ? duration_cast<milliseconds>(deadline - now) : milliseconds::zero();
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "serial_client.h"
+#include "serial_client_device_access_handler.h"
+#include "serial_config.h"
+
+#include <wblib/json_utils.h>
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Polls channels of a device described by its template through the wb-mqtt-serial register and events reader, so
+// registers are merged, scheduled and decoded the same way as by wb-mqtt-serial. A poll is one open port cycle of the
+// reader limited by the bus time budget. Devices with WB Modbus extension report changes by events.
+class TChannelMonitor
+{
+public:
+    /**
+     * @brief Monitors channels of the template with given names and poll intervals on the device, all readable
+     * channels are monitored if the list is empty
+     */
+    TChannelMonitor(PSerialDevice device,
+                    const TDeviceProtocolParams& params,
+                    const Json::Value& deviceTemplate,
+                    const Json::Value& channels,
+                    const std::chrono::milliseconds& defaultInterval);
+
+    /**
+     * @brief Reads due registers and events, returns values changed since the previous poll and names of failed
+     * channels. Values are formatted by wb-mqtt-serial like values of MQTT controls.
+     */
+    Json::Value Poll(TPort& port, const std::chrono::milliseconds& budget);
+
+    /**
+     * @brief Returns time until the next register is due or events should be read
+     */
+    std::chrono::milliseconds GetNextPollDelay() const;
+
+    std::vector<std::string> GetChannelNames() const;
+
+    /**
+     * @brief Disables events of monitored registers if the device reports them, so it doesn't keep sending events
+     * nobody reads after monitoring stops
+     */
+    void DisableEvents(TPort& port);
+
+private:
+    struct TChannel
+    {
+        std::string Name;
+        std::string Value;
+        bool Error = false;
+
+        // register type of events, which is the read function code, and the register address
+        uint8_t Function = 0;
+        uint16_t Address = 0;
+    };
+
+    PSerialDevice Device;
+    std::vector<TChannel> Channels;
+    std::map<PRegister, size_t> ChannelIndexes;
+    std::unique_ptr<TSerialClientRegisterAndEventsReader> Reader;
+    std::unique_ptr<TSerialClientDeviceAccessHandler> AccessHandler;
+
+    void OnRegister(PRegister reg, Json::Value& result);
+};
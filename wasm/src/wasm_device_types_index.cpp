@@ -0,0 +1,79 @@
+#include "wasm_device_types_index.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+TDeviceTypesIndex::TDeviceTypesIndex(const Json::Value& deviceTypeGroups)
+{
+    for (const auto& group: deviceTypeGroups) {
+        for (const auto& type: group["types"]) {
+            if (type["deprecated"].asBool()) {
+                continue;
+            }
+
+            for (const auto& hw: type["hw"]) {
+                Index[hw["signature"].asString()].push_back({type["type"].asString(), hw["fw"].asString()});
+            }
+        }
+    }
+
+    for (auto& entries: Index) {
+        std::stable_sort(entries.second.begin(), entries.second.end(), [](const TEntry& a, const TEntry& b) {
+            return CompareFirmwareVersions(a.MinFw, b.MinFw) > 0;
+        });
+    }
+}
+
+std::vector<std::string> TDeviceTypesIndex::Find(const std::string& signature, const std::string& fw) const
+{
+    std::vector<std::string> res;
+    auto entries = Index.find(signature);
+
+    if (entries == Index.end()) {
+        return res;
+    }
+
+    for (const auto& entry: entries->second) {
+        if (entry.MinFw.empty() || fw.empty() || CompareFirmwareVersions(fw, entry.MinFw) >= 0) {
+            if (std::find(res.begin(), res.end(), entry.Type) == res.end()) {
+                res.push_back(entry.Type);
+            }
+        }
+    }
+
+    return res;
+}
+
+int CompareFirmwareVersions(const std::string& a, const std::string& b)
+{
+    const char* pa = a.c_str();
+    const char* pb = b.c_str();
+
+    while (*pa || *pb) {
+        char* end;
+        auto va = strtol(pa, &end, 10);
+        pa = end;
+        auto vb = strtol(pb, &end, 10);
+        pb = end;
+
+        if (va != vb) {
+            return va < vb ? -1 : 1;
+        }
+
+        // skip suffixes like "-rc1" up to the next component
+        while (*pa && *pa != '.') {
+            ++pa;
+        }
+        while (*pb && *pb != '.') {
+            ++pb;
+        }
+        if (*pa) {
+            ++pa;
+        }
+        if (*pb) {
+            ++pb;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <wblib/json_utils.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Finds device types by device signature and firmware version, built from config/GetDeviceTypes result
+class TDeviceTypesIndex
+{
+public:
+    explicit TDeviceTypesIndex(const Json::Value& deviceTypeGroups);
+
+    /**
+     * @brief Returns not deprecated device types matching the signature and supported by the firmware,
+     *        types requiring newer firmware go first
+     */
+    std::vector<std::string> Find(const std::string& signature, const std::string& fw) const;
+
+private:
+    struct TEntry
+    {
+        std::string Type;
+        std::string MinFw;
+    };
+
+    std::unordered_map<std::string, std::vector<TEntry>> Index;
+};
+
+/**
+ * @brief Compares dot separated firmware versions numerically, returns negative, zero or positive value
+ */
+int CompareFirmwareVersions(const std::string& a, const std::string& b);
@@ -0,0 +1,165 @@
+#include "wasm_firmware_update.h"
+#include "log.h"
+#include "wasm_modbus.h"
+
+#define LOG(logger) logger.Log() << "[wasm firmware] "
+
+using namespace std::chrono;
+using namespace std::chrono_literals;
+
+namespace
+{
+    const uint16_t REBOOT_TO_BOOTLOADER_REGISTER = 129;
+    const uint16_t INFO_BLOCK_REGISTER = 0x1000;
+    const uint16_t DATA_BLOCK_REGISTER = 0x2000;
+
+    // block sizes accepted by the bootloader
+    const size_t INFO_BLOCK_SIZE = 32;
+    const size_t DATA_BLOCK_SIZE = 136;
+
+    const uint8_t READ_HOLDING_REGISTERS = 3;
+    const uint8_t WRITE_SINGLE_REGISTER = 6;
+    const uint8_t WRITE_MULTIPLE_REGISTERS = 16;
+    const size_t WRITE_REPLY_SIZE = 8;
+    const size_t READ_REPLY_SIZE = 7;
+
+    // the bootloader erases flash after the info block, the device starts the bootloader after reboot
+    const auto INFO_BLOCK_DELAY = 1s;
+    const auto DATA_BLOCK_DELAY = 100ms;
+    const auto BOOTLOADER_START_DELAY = 500ms;
+    const auto BLOCK_ATTEMPTS = 3;
+
+    // the bootloader replies to a read at once, with data or an exception
+    const auto PROBE_DELAY = 100ms;
+    const auto PROBE_ATTEMPTS = 2;
+
+    std::vector<uint8_t> MakeWriteFrame(uint8_t slaveId, uint16_t address, const uint8_t* data, size_t size)
+    {
+        auto count = size / 2;
+        std::vector<uint8_t> frame{slaveId,
+                                   WRITE_MULTIPLE_REGISTERS,
+                                   static_cast<uint8_t>(address >> 8),
+                                   static_cast<uint8_t>(address & 0xFF),
+                                   static_cast<uint8_t>(count >> 8),
+                                   static_cast<uint8_t>(count & 0xFF),
+                                   static_cast<uint8_t>(size)};
+        frame.insert(frame.end(), data, data + size);
+        ModbusRTU::AppendCRC(frame);
+        return frame;
+    }
+}
+
+TFirmwareUpdater::TFirmwareUpdater(TWASMPort& port, uint8_t slaveId, const std::vector<uint8_t>& firmware)
+    : Port(port),
+      SlaveId(slaveId),
+      Firmware(firmware)
+{
+    if (Firmware.size() <= INFO_BLOCK_SIZE) {
+        throw std::runtime_error("firmware file is too short");
+    }
+}
+
+void TFirmwareUpdater::RebootToBootloader(const TSerialPortConnectionSettings& deviceSettings)
+{
+    Port.ApplySerialPortSettings(deviceSettings);
+
+    std::vector<uint8_t> frame{SlaveId,
+                               WRITE_SINGLE_REGISTER,
+                               REBOOT_TO_BOOTLOADER_REGISTER >> 8,
+                               REBOOT_TO_BOOTLOADER_REGISTER & 0xFF,
+                               0,
+                               1};
+    ModbusRTU::AppendCRC(frame);
+
+    // the device may reboot before replying, so the reply isn't checked
+    Port.WriteBytes(frame.data(), frame.size());
+    Port.ReadReply(WRITE_REPLY_SIZE, DATA_BLOCK_DELAY + Port.GetSendTimeBytes(frame.size() + WRITE_REPLY_SIZE), 0us);
+    Port.Listen(duration_cast<milliseconds>(BOOTLOADER_START_DELAY));
+}
+
+TSerialPortConnectionSettings TFirmwareUpdater::FindBootloaderSettings(const std::vector<int>& baudRates)
+{
+    // any valid reply tells the bootloader got the request, so the probe doesn't change anything in the device
+    std::vector<uint8_t> frame{SlaveId, READ_HOLDING_REGISTERS, 0, 0, 0, 1};
+    ModbusRTU::AppendCRC(frame);
+
+    for (auto baudRate: baudRates) {
+        TSerialPortConnectionSettings settings(baudRate, 'N', 8, 2);
+        Port.ApplySerialPortSettings(settings);
+
+        auto timeout = PROBE_DELAY + Port.GetSendTimeBytes(frame.size() + READ_REPLY_SIZE);
+        auto frameTimeout = Port.GetSendTimeBytes(3.5);
+
+        for (auto attempt = 1; attempt <= PROBE_ATTEMPTS; ++attempt) {
+            Port.WriteBytes(frame.data(), frame.size());
+            auto reply = Port.ReadReply(READ_REPLY_SIZE, timeout, frameTimeout);
+
+            if (reply.size() >= 5 && reply[0] == SlaveId && ModbusRTU::IsValidFrame(reply.data(), reply.size())) {
+                LOG(Info) << "bootloader replies at " << baudRate;
+                return settings;
+            }
+        }
+
+        LOG(Debug) << "no reply from bootloader at " << baudRate;
+    }
+
+    LOG(Warn) << "bootloader doesn't reply to probes, trying " << baudRates.back();
+    return TSerialPortConnectionSettings(baudRates.back(), 'N', 8, 2);
+}
+
+void TFirmwareUpdater::Write(const TSerialPortConnectionSettings& bootloaderSettings,
+                             const TProgressCallback& onProgress)
+{
+    Port.ApplySerialPortSettings(bootloaderSettings);
+
+    // all frames are made in advance, so the next block is sent right after the previous one is acknowledged
+    std::vector<std::vector<uint8_t>> frames;
+    frames.push_back(MakeWriteFrame(SlaveId, INFO_BLOCK_REGISTER, Firmware.data(), INFO_BLOCK_SIZE));
+
+    for (size_t offset = INFO_BLOCK_SIZE; offset < Firmware.size(); offset += DATA_BLOCK_SIZE) {
+        std::vector<uint8_t> block(DATA_BLOCK_SIZE, 0);
+        std::copy_n(Firmware.begin() + offset, std::min(DATA_BLOCK_SIZE, Firmware.size() - offset), block.begin());
+        frames.push_back(MakeWriteFrame(SlaveId, DATA_BLOCK_REGISTER, block.data(), block.size()));
+    }
+
+    LOG(Info) << "writing " << Firmware.size() << " bytes in " << frames.size() << " blocks at "
+              << bootloaderSettings.BaudRate;
+
+    TProgress progress;
+    progress.Total = Firmware.size();
+    auto start = steady_clock::now();
+
+    for (size_t i = 0; i < frames.size(); ++i) {
+        WriteBlock(frames[i], i ? DATA_BLOCK_DELAY : INFO_BLOCK_DELAY);
+
+        progress.Written = std::min(INFO_BLOCK_SIZE + i * DATA_BLOCK_SIZE, Firmware.size());
+        auto elapsed = duration_cast<duration<double>>(steady_clock::now() - start).count();
+        progress.Speed = elapsed > 0 ? progress.Written / elapsed : 0;
+        onProgress(progress);
+    }
+
+    LOG(Info) << "firmware written at " << static_cast<int>(progress.Speed) << " bytes/s";
+}
+
+void TFirmwareUpdater::WriteBlock(const std::vector<uint8_t>& frame, const microseconds& delay)
+{
+    auto timeout = delay + Port.GetSendTimeBytes(frame.size() + WRITE_REPLY_SIZE);
+    auto frameTimeout = Port.GetSendTimeBytes(3.5);
+
+    for (auto attempt = 1; attempt <= BLOCK_ATTEMPTS; ++attempt) {
+        Port.WriteBytes(frame.data(), frame.size());
+        auto reply = Port.ReadReply(WRITE_REPLY_SIZE, timeout, frameTimeout);
+
+        if (reply.size() >= 5 && reply[0] == SlaveId && ModbusRTU::IsValidFrame(reply.data(), reply.size())) {
+            if (reply[1] == WRITE_MULTIPLE_REGISTERS) {
+                return;
+            }
+
+            throw std::runtime_error("bootloader rejected block with exception " + std::to_string(reply[2]));
+        }
+
+        LOG(Warn) << "no reply to block, attempt " << attempt;
+    }
+
+    throw std::runtime_error("bootloader doesn't reply");
+}
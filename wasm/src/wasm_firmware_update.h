@@ -0,0 +1,49 @@
+#pragma once
+
+#include "wasm_port.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// Firmware update of Wiren Board devices through their bootloader. Firmware file starts with the info block, which is
+// written first, then the image is written block by block.
+class TFirmwareUpdater
+{
+public:
+    struct TProgress
+    {
+        size_t Written = 0;
+        size_t Total = 0;
+
+        // bytes of the image per second
+        double Speed = 0;
+    };
+
+    using TProgressCallback = std::function<void(const TProgress&)>;
+
+    TFirmwareUpdater(TWASMPort& port, uint8_t slaveId, const std::vector<uint8_t>& firmware);
+
+    /**
+     * @brief Asks the device running the main firmware to reboot into the bootloader
+     */
+    void RebootToBootloader(const TSerialPortConnectionSettings& deviceSettings);
+
+    /**
+     * @brief Returns line settings of the highest baud rate the bootloader replies at, the rates are tried in the given
+     * order. The last rate is returned if the bootloader replies at none, the write of the info block checks it then.
+     */
+    TSerialPortConnectionSettings FindBootloaderSettings(const std::vector<int>& baudRates);
+
+    /**
+     * @brief Writes the firmware at the bootloader line settings, throws on a failed block
+     */
+    void Write(const TSerialPortConnectionSettings& bootloaderSettings, const TProgressCallback& onProgress);
+
+private:
+    TWASMPort& Port;
+    uint8_t SlaveId;
+    std::vector<uint8_t> Firmware;
+
+    void WriteBlock(const std::vector<uint8_t>& frame, const std::chrono::microseconds& delay);
+};
@@ -0,0 +1,134 @@
+#include "wasm_modbus.h"
+#include "crc16.h"
+
+namespace
+{
+    const uint8_t MAX_SLAVE_ID = 247;
+    const uint8_t EXCEPTION_FLAG = 0x80;
+    const size_t MIN_FRAME_SIZE = 4;
+    const size_t MAX_FRAME_SIZE = 256;
+
+    // Possible sizes of a request or a response starting at the position, based on the function code.
+    // Checking only these sizes keeps random data from looking like frames with a matching CRC.
+    std::vector<size_t> GetFrameSizes(const uint8_t* data, size_t size)
+    {
+        std::vector<size_t> res;
+        auto function = data[1];
+
+        if (function & EXCEPTION_FLAG) {
+            res.push_back(5);
+            return res;
+        }
+
+        switch (function) {
+            case 1:
+            case 2:
+            case 3:
+            case 4:
+                // read request or response with byte count
+                res.push_back(8);
+                if (size > 2) {
+                    res.push_back(5 + data[2]);
+                }
+                break;
+            case 5:
+            case 6:
+                res.push_back(8);
+                break;
+            case 15:
+            case 16:
+                // response or write request with byte count
+                res.push_back(8);
+                if (size > 6) {
+                    res.push_back(9 + data[6]);
+                }
+                break;
+        }
+
+        return res;
+    }
+}
+
+void ModbusRTU::AppendCRC(std::vector<uint8_t>& frame)
+{
+    // wb-mqtt-serial's CRC has the byte sent first in the high byte
+    auto crc = CRC16::CalculateCRC16(frame.data(), frame.size());
+    frame.push_back(crc >> 8);
+    frame.push_back(crc & 0xFF);
+}
+
+bool ModbusRTU::IsValidFrame(const uint8_t* frame, size_t size)
+{
+    if (size < MIN_FRAME_SIZE) {
+        return false;
+    }
+
+    auto crc = CRC16::CalculateCRC16(frame, size - 2);
+    return frame[size - 2] == (crc >> 8) && frame[size - 1] == (crc & 0xFF);
+}
+
+double ModbusRTU::TTrafficStats::GetScore() const
+{
+    return Bytes ? static_cast<double>(FramesBytes) / Bytes : 0;
+}
+
+ModbusRTU::TTrafficStats ModbusRTU::AnalyzeTraffic(const std::vector<uint8_t>& data)
+{
+    TTrafficStats stats;
+    stats.Bytes = data.size();
+
+    for (size_t i = 0; i + MIN_FRAME_SIZE <= data.size();) {
+        size_t frameSize = 0;
+
+        if (data[i] && data[i] <= MAX_SLAVE_ID) {
+            for (auto size: GetFrameSizes(&data[i], data.size() - i)) {
+                if (size <= MAX_FRAME_SIZE && i + size <= data.size() && IsValidFrame(&data[i], size)) {
+                    frameSize = size;
+                    break;
+                }
+            }
+        }
+
+        if (!frameSize) {
+            ++i;
+            continue;
+        }
+
+        ++stats.Frames;
+        stats.FramesBytes += frameSize;
+        stats.SlaveIds.insert(data[i]);
+        i += frameSize;
+    }
+
+    return stats;
+}
+
+std::vector<uint8_t> ModbusTCP::MakeFrame(uint16_t transactionId, uint8_t unitId, const std::vector<uint8_t>& pdu)
+{
+    auto length = pdu.size() + 1;
+    std::vector<uint8_t> frame{static_cast<uint8_t>(transactionId >> 8),
+                               static_cast<uint8_t>(transactionId & 0xFF),
+                               0,
+                               0,
+                               static_cast<uint8_t>(length >> 8),
+                               static_cast<uint8_t>(length & 0xFF),
+                               unitId};
+    frame.insert(frame.end(), pdu.begin(), pdu.end());
+    return frame;
+}
+
+size_t ModbusTCP::GetFrameSize(const uint8_t* data, size_t size)
+{
+    if (size < HEADER_SIZE) {
+        return 0;
+    }
+
+    // length counts the unit id and the PDU
+    size_t frameSize = HEADER_SIZE - 1 + (data[4] << 8 | data[5]);
+    return frameSize <= size ? frameSize : 0;
+}
+
+uint16_t ModbusTCP::GetTransactionId(const uint8_t* frame)
+{
+    return frame[0] << 8 | frame[1];
+}
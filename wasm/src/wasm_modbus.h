@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <set>
+#include <vector>
+
+// Modbus RTU framing helpers for the module's own bus operations
+namespace ModbusRTU
+{
+    /**
+     * @brief Appends CRC to the frame, low byte first
+     */
+    void AppendCRC(std::vector<uint8_t>& frame);
+
+    /**
+     * @brief Checks frame CRC, the frame includes CRC
+     */
+    bool IsValidFrame(const uint8_t* frame, size_t size);
+
+    struct TTrafficStats
+    {
+        size_t Bytes = 0;
+        size_t Frames = 0;
+        size_t FramesBytes = 0;
+        std::set<uint8_t> SlaveIds;
+
+        /**
+         * @brief Part of received bytes which belong to valid frames
+         */
+        double GetScore() const;
+    };
+
+    /**
+     * @brief Finds valid frames of standard functions in the data received from the bus
+     */
+    TTrafficStats AnalyzeTraffic(const std::vector<uint8_t>& data);
+}
+
+// Modbus TCP framing helpers for gateways
+namespace ModbusTCP
+{
+    // MBAP header with unit id
+    const size_t HEADER_SIZE = 7;
+
+    std::vector<uint8_t> MakeFrame(uint16_t transactionId, uint8_t unitId, const std::vector<uint8_t>& pdu);
+
+    /**
+     * @brief Returns size of the frame at the start of the data, zero if the frame isn't received completely
+     */
+    size_t GetFrameSize(const uint8_t* data, size_t size);
+
+    uint16_t GetTransactionId(const uint8_t* frame);
+}
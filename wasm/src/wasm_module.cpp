@@ -1,6 +1,15 @@
 #include "log.h"
 #include "port/feature_port.h"
+#include "wasm_channel_monitor.h"
+#include "wasm_device_types_index.h"
+#include "wasm_firmware_update.h"
+#include "wasm_modbus.h"
 #include "wasm_port.h"
+#include "wasm_precomputed.h"
+#include "wasm_replay_port.h"
+#include "wasm_reply_cache.h"
+#include "wasm_socket_port.h"
+#include "wasm_templates_pack.h"
 
 #include "rpc/rpc_config_handler.h"
 #include "rpc/rpc_device_load_config_task.h"
@@ -9,6 +18,11 @@
 #include "rpc/rpc_port_scan_serial_client_task.h"
 
 #include <emscripten/bind.h>
+#include <emscripten/heap.h>
+#include <emscripten/val.h>
+#include <fstream>
+#include <malloc.h>
+#include <unistd.h>
 
 #define LOG(logger) logger.Log() << "[wasm] "
 
@@ -27,13 +41,59 @@ namespace
     const auto DEVICE_LOAD_CONFIG_SCHEMA_FILE = "wb-mqtt-serial-rpc-device-load-config-request.schema.json";
     const auto DEVICE_SET_SCHEMA_FILE = "wb-mqtt-serial-rpc-device-set-request.schema.json";
 
+    // reply cache takes an eighth of the largest heap unless the page sets its size
+    const auto REPLY_CACHE_HEAP_SHARE = 8;
+
+    // heap usage after which caches are dropped, a half of the largest heap unless the page sets it, zero disables
+    // the check
+    size_t HeapBudget = emscripten_get_heap_max() / 2;
+
+    // time of listening to the bus at one line setting
+    const auto SNIFF_DURATION = 300ms;
+
+    // classic scan probes slave ids with reading of one holding register, a reply is a normal or an exception
+    // response, the probe waits for the time of the request and the reply on the line and the device delay
+    const uint8_t CLASSIC_SCAN_FUNCTION = 3;
+    const auto CLASSIC_SCAN_REPLY_SIZE = 7;
+    const auto CLASSIC_SCAN_REPLY_DELAY = 30ms;
+    const auto MAX_SLAVE_ID = 247;
+
+    // gateways reply for each probed device in turn, the timeout covers the line timeout of the gateway
+    const auto CLASSIC_SCAN_GATEWAY_TIMEOUT = 1s;
+    const auto PIPELINE_FRAME_TIMEOUT = 1ms;
+
+    // requests sent to a Modbus TCP gateway at once, gateways usually queue 8 to 16 requests per connection
+    const auto MAX_PIPELINED_REQUESTS = 8;
+
+    // WB bootloaders work at 9600 8N2, newer ones also at higher rates, so rates are tried from the highest one
+    const std::vector<int> BOOTLOADER_BAUD_RATES = {115200, 57600, 38400, 19200, 9600};
+
+    // channels without a period in the template are read once a second, a poll uses the bus for 100 ms at most so
+    // other requests aren't delayed much
+    const auto MONITOR_INTERVAL = 1s;
+    const auto MONITOR_BUDGET = 100ms;
+
+    // transports of the port, module instances working through gateways get one of socket transports
+    const auto SERIAL_TRANSPORT = "serial";
+    const auto RTU_OVER_TCP_TRANSPORT = "rtu-over-tcp";
+    const auto MODBUS_TCP_TRANSPORT = "modbus-tcp";
+
     const auto PROTOCOLS_DIR = "protocols";
     const auto TEMPLATES_DIR = "templates";
+    const auto TEMPLATES_PACK_FILE = "templates.pack";
 
-    const auto CommonSchema = WBMQTT::JSON::Parse(COMMON_SCHEMA_FILE);
+    // time of one initialization step, other requests are served between the steps
+    const auto INIT_SLICE_TIME = 20ms;
+
+    Json::Value CommonSchema;
 
     auto Prepare = true;
-    auto Port = std::make_shared<TFeaturePort>(std::make_shared<TWASMPort>(), false);
+    std::unique_ptr<TTemplatesUnpacker> TemplatesUnpacker;
+    size_t TemplatesCount = 0;
+    std::string Transport = SERIAL_TRANSPORT;
+    std::shared_ptr<TWASMPort> WASMPort = std::make_shared<TWASMPort>();
+    std::shared_ptr<TReplayPort> ReplayPort;
+    auto Port = std::make_shared<TFeaturePort>(WASMPort, false);
     TSerialDeviceFactory DeviceFactory;
     std::list<PSerialDevice> PolledDevices;
 
@@ -43,50 +103,162 @@ namespace
     std::shared_ptr<TDevicesConfedSchemasMap> DevicesSchemasMap;
     std::shared_ptr<TProtocolConfedSchemasMap> ProtocolSchemasMap;
 
-    class THelper
+    TReplyCache ReplyCache(emscripten_get_heap_max() / REPLY_CACHE_HEAP_SHARE);
+
+    // monitored device and the request it was started with, the port may be used for other devices between polls
+    std::unique_ptr<TChannelMonitor> Monitor;
+    Json::Value MonitorRequest;
+    std::unique_ptr<TDeviceTypesIndex> DeviceTypesIndex;
+
+    // counts of schemas read from precomputed files and generated at runtime, cached replies aren't counted
+    size_t PrecomputedSchemas = 0;
+    size_t GeneratedSchemas = 0;
+
+    // registers rejected by a device with a particular firmware and its largest read found during the session
+    std::map<std::string, TWASMPort::TReadLimits> LearnedReadLimits;
+
+    // read functions of register types in templates
+    const std::map<std::string, uint8_t> READ_FUNCTIONS = {
+        {"coil", 1},
+        {"discrete", 2},
+        {"holding", 3},
+        {"input", 4},
+    };
+
+    // Removes entries of all devices with the slave id from a map with device keys
+    template<class TMap> void EraseSlaveEntries(TMap& map, const std::string& slaveId)
     {
+        auto prefix = slaveId + ":";
 
-        void ParseRequest(const std::string& requestString)
-        {
-            std::stringstream stream(requestString);
-            Json::CharReaderBuilder builder;
-            Json::String errors;
+        for (auto it = map.begin(); it != map.end();) {
+            if (it->first.compare(0, prefix.size(), prefix) == 0) {
+                it = map.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    // Parses the request in place, parseFromStream would copy it twice
+    Json::Value ParseJson(const std::string& data)
+    {
+        static std::unique_ptr<Json::CharReader> reader(Json::CharReaderBuilder().newCharReader());
+        Json::String errors;
+        Json::Value value;
+
+        if (!reader->parse(data.data(), data.data() + data.size(), &value, &errors)) {
+            throw std::runtime_error("Failed to parse JSON:" + errors);
+        }
+
+        return value;
+    }
+
+    const Json::Value& GetCommonSchema()
+    {
+        if (CommonSchema.isNull()) {
+            CommonSchema = WBMQTT::JSON::Parse(COMMON_SCHEMA_FILE);
+        }
+
+        return CommonSchema;
+    }
+
+    // Makes the map of unpacked templates. Parsed templates stay in the map, so it's dropped with other caches when
+    // the heap budget is exceeded and is made again on demand.
+    void LoadTemplateMap()
+    {
+        TemplateMap =
+            std::make_shared<TTemplateMap>(LoadConfigTemplatesSchema(TEMPLATES_SCHEMA_FILE, GetCommonSchema()));
+        TemplateMap->AddTemplatesDir(TEMPLATES_DIR);
+    }
+
+    // Does a part of initialization which fits into the time limit, returns true when initialization is finished
+    bool InitializeSlice(const steady_clock::duration& timeLimit)
+    {
+        if (!Prepare) {
+            return true;
+        }
+
+        auto start = steady_clock::now();
+
+        if (!TemplatesUnpacker) {
+            RegisterProtocols(DeviceFactory);
+            TemplatesUnpacker = std::make_unique<TTemplatesUnpacker>(TEMPLATES_PACK_FILE, TEMPLATES_DIR);
+        }
+
+        do {
+            if (!TemplatesUnpacker->UnpackNext()) {
+                TemplatesCount = TemplatesUnpacker->GetUnpackedCount();
+                LOG(Info) << TemplatesCount << " templates unpacked";
 
-            if (!Json::parseFromStream(builder, stream, &Request, &errors)) {
-                throw std::runtime_error("Failed to parse request:" + errors);
+                // templates are shipped packed, the pack isn't needed after unpacking
+                TemplatesUnpacker.reset();
+                unlink(TEMPLATES_PACK_FILE);
+
+                Prepare = false;
+                LoadTemplateMap();
+                return true;
             }
+        } while (steady_clock::now() - start < timeLimit);
+
+        return false;
+    }
+
+    void Initialize()
+    {
+        while (!InitializeSlice(steady_clock::duration::max())) {
+        }
+    }
+
+    TTemplateMap& GetTemplateMap()
+    {
+        Initialize();
+
+        if (!TemplateMap) {
+            LoadTemplateMap();
+        }
+
+        return *TemplateMap;
+    }
+
+    // Schemas and device types are precomputed, so schema maps and the config handler are only made for templates
+    // without precomputed schemas and for builds without precomputed files
+    TRPCConfigHandler& GetConfigHandler()
+    {
+        GetTemplateMap();
+
+        if (!ConfigHandler) {
+            DevicesSchemasMap =
+                std::make_shared<TDevicesConfedSchemasMap>(*TemplateMap, DeviceFactory, GetCommonSchema());
+            ProtocolSchemasMap = //
+                std::make_shared<TProtocolConfedSchemasMap>(PROTOCOLS_DIR, GetCommonSchema());
+            ConfigHandler = //
+                std::make_shared<TRPCConfigHandler>(WBMQTT::JSON::Parse(PORTS_SCHEMA_FILE),
+                                                    TemplateMap,
+                                                    *DevicesSchemasMap,
+                                                    *ProtocolSchemasMap,
+                                                    WBMQTT::JSON::Parse(GROUP_NAMES_FILE));
         }
 
+        return *ConfigHandler;
+    }
+
+    class THelper
+    {
     public:
         Json::Value Request;
         TDeviceProtocolParams Params;
         PDeviceTemplate Template = nullptr;
         PSerialDevice Device = nullptr;
+        TWASMPort::TReadLimits Limits;
+        std::string DeviceKey;
 
         THelper(const std::string& requestString,
                 const std::string& schemaFilePath,
                 const std::string& rpcName,
                 bool deviceRequest = false)
         {
-            if (Prepare) {
-                RegisterProtocols(DeviceFactory);
-                TemplateMap =
-                    std::make_shared<TTemplateMap>(LoadConfigTemplatesSchema(TEMPLATES_SCHEMA_FILE, CommonSchema));
-                DevicesSchemasMap =
-                    std::make_shared<TDevicesConfedSchemasMap>(*TemplateMap, DeviceFactory, CommonSchema);
-                ProtocolSchemasMap = //
-                    std::make_shared<TProtocolConfedSchemasMap>(PROTOCOLS_DIR, CommonSchema);
-                ConfigHandler = //
-                    std::make_shared<TRPCConfigHandler>(WBMQTT::JSON::Parse(PORTS_SCHEMA_FILE),
-                                                        TemplateMap,
-                                                        *DevicesSchemasMap,
-                                                        *ProtocolSchemasMap,
-                                                        WBMQTT::JSON::Parse(GROUP_NAMES_FILE));
-                TemplateMap->AddTemplatesDir(TEMPLATES_DIR);
-                Prepare = false;
-            }
-
-            ParseRequest(requestString);
+            Initialize();
+            Request = ParseJson(requestString);
 
             if (!schemaFilePath.empty()) {
                 ValidateRPCRequest(Request, LoadRPCRequestSchema(schemaFilePath, rpcName));
@@ -97,20 +269,34 @@ namespace
             }
 
             Params = DeviceFactory.GetProtocolParams("modbus");
+            DeviceKey = Request["slave_id"].asString() + ":" + Request["device_type"].asString() + ":" +
+                        Request["fw"].asString();
 
-            auto config = std::make_shared<TDeviceConfig>("WASM Device", Request["slave_id"].asString(), "modbus");
-            config->MaxRegHole = Modbus::MAX_HOLE_CONTINUOUS_16_BIT_REGISTERS;
-            config->MaxBitHole = Modbus::MAX_HOLE_CONTINUOUS_1_BIT_REGISTERS;
-            config->MaxReadRegisters = Modbus::MAX_READ_REGISTERS;
+            auto limits = LearnedReadLimits.find(DeviceKey);
+
+            if (limits != LearnedReadLimits.end()) {
+                Limits = limits->second;
+            }
 
             try {
-                Template = TemplateMap->GetTemplate(Request["device_type"].asString());
-                Device = Params.factory->CreateDevice(Template->GetTemplate(), config, Params.protocol);
+                Template = GetTemplateMap().GetTemplate(Request["device_type"].asString());
+                CreateDevice();
             } catch (const std::out_of_range& e) {
                 LOG(Error) << "Unable to create device: " << e.what();
             }
         }
 
+        void CreateDevice()
+        {
+            auto config = std::make_shared<TDeviceConfig>("WASM Device", Request["slave_id"].asString(), "modbus");
+
+            if (Limits.MaxReadRegisters) {
+                config->MaxReadRegisters = Limits.MaxReadRegisters;
+            }
+
+            Device = Params.factory->CreateDevice(Template->GetTemplate(), config, Params.protocol);
+        }
+
         TSerialClientDeviceAccessHandler GetAccessHandler()
         {
             std::list<PSerialDevice> list;
@@ -124,33 +310,168 @@ namespace
         }
     };
 
-    void SendReply(const Json::Value& reply)
+    // Reads the whole file stored in the module file system by the page
+    std::vector<uint8_t> ReadFile(const std::string& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+
+        if (!file) {
+            throw std::runtime_error("can't open file " + path);
+        }
+
+        return std::vector<uint8_t>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    }
+
+    // Logs port counters of the finished RPC, compare the overhead with and without transact to benchmark it
+    void LogPortStats()
+    {
+        auto stats = WASMPort->TakeStats();
+
+        if (!stats.Transactions) {
+            return;
+        }
+
+        auto overhead = stats.CrossingTime - stats.IoTime;
+        LOG(Info) << stats.Transactions << " transactions in " << stats.Crossings << " port calls, Asyncify overhead "
+                  << overhead.count() / stats.Transactions << " us per transaction";
+    }
+
+    // Drops caches which can be rebuilt if the heap usage exceeds the budget. The wasm memory can't shrink, but the
+    // freed memory is reused instead of growing the heap further.
+    void CheckHeapBudget()
+    {
+        auto used = static_cast<size_t>(mallinfo().uordblks);
+
+        if (!HeapBudget || used <= HeapBudget) {
+            return;
+        }
+
+        ReplyCache.Clear();
+        DeviceTypesIndex.reset();
+
+        // the config handler and schema maps refer to the template map, so they are dropped first
+        ConfigHandler.reset();
+        DevicesSchemasMap.reset();
+        ProtocolSchemasMap.reset();
+        TemplateMap.reset();
+
+        LOG(Warn) << "heap usage " << used << " bytes exceeds budget " << HeapBudget << ", caches dropped, "
+                  << mallinfo().uordblks << " bytes used now";
+    }
+
+    void SendData(const std::string& data, bool partial)
     {
-        std::stringstream stream;
-        WBMQTT::JSON::MakeWriter()->write(reply, &stream);
+        if (!partial) {
+            // a request which isn't followed by a read is sent before the RPC finishes
+            WASMPort->Flush();
+            LogPortStats();
+        }
 
         // clang-format off
         EM_ASM(
         {
-            let data = new String();
+            let data = UTF8ToString($0, $1);
 
-            for (let i = 0; i < $1; ++i) {
-                data += String.fromCharCode(getValue($0 + i, 'i8'));
+            if ($2) {
+                Module.parseProgress(data);
+            } else {
+                Module.parseReply(data);
             }
-
-            Module.parseReply(data);
         },
-        stream.str().c_str(), stream.str().length());
+        data.c_str(), data.length(), partial);
         // clang-format on
+
+        if (!partial) {
+            CheckHeapBudget();
+        }
+    }
+
+    // Serializes the value between the prefix and the suffix, so reply wrappers don't need a copy of the tree
+    std::string Serialize(const Json::Value& value, const char* prefix = "", const char* suffix = "")
+    {
+        static auto writer = WBMQTT::JSON::MakeWriter();
+
+        std::ostringstream stream;
+        stream << prefix;
+        writer->write(value, &stream);
+        stream << suffix;
+        return stream.str();
+    }
+
+    void SendReply(const Json::Value& reply, bool partial = false)
+    {
+        SendData(Serialize(reply), partial);
+    }
+
+    std::string SerializeResult(const Json::Value& result)
+    {
+        return Serialize(result, "{\"error\":null,\"result\":", "}");
     }
 
     void OnResult(const Json::Value& result)
     {
-        Json::Value reply;
-        reply["error"] = Json::nullValue;
-        reply["result"] = result;
+        SendData(SerializeResult(result), false);
+    }
 
-        SendReply(reply);
+    // Sends the cached reply if there is one, otherwise makes the reply and caches it
+    void SendCachedReply(const std::string& key, const std::function<std::string()>& makeReply)
+    {
+        auto cached = ReplyCache.Find(key);
+
+        if (cached) {
+            SendData(*cached, false);
+            return;
+        }
+
+        auto reply = makeReply();
+        ReplyCache.Insert(key, reply);
+        SendData(reply, false);
+    }
+
+    // Makes the reply from the result generated at build time, returns an empty string if there is none
+    std::string MakePrecomputedReply(const std::string& path)
+    {
+        std::string result;
+
+        if (!Precomputed::Read(path, result)) {
+            return std::string();
+        }
+
+        return "{\"error\":null,\"result\":" + result + "}";
+    }
+
+    const std::string& GetCommonSchemaVersion()
+    {
+        static std::string version;
+
+        if (version.empty()) {
+            version = std::to_string(std::hash<std::string>()(Serialize(GetCommonSchema()["definitions"])));
+        }
+
+        return version;
+    }
+
+    // Removes definitions shared with the common schema, the client restores them from its copy of the common
+    // schema using the list stored in "$common"
+    void RemoveCommonDefinitions(Json::Value& schema)
+    {
+        const auto& commonDefinitions = GetCommonSchema()["definitions"];
+        auto& definitions = schema["definitions"];
+        Json::Value common;
+
+        common["version"] = GetCommonSchemaVersion();
+        common["definitions"] = Json::Value(Json::arrayValue);
+
+        if (definitions.isObject()) {
+            for (const auto& name: definitions.getMemberNames()) {
+                if (commonDefinitions.isMember(name) && commonDefinitions[name] == definitions[name]) {
+                    common["definitions"].append(name);
+                    definitions.removeMember(name);
+                }
+            }
+        }
+
+        schema["$common"] = common;
     }
 
     void OnError(const WBMQTT::TMqttRpcErrorCode& errorCode, const std::string& errorMessage)
@@ -164,25 +485,465 @@ namespace
 
         SendReply(reply);
     }
+
+    void OnProgress(const Json::Value& progress)
+    {
+        SendReply(progress, true);
+    }
+
+    void MergeLoadConfigResult(Json::Value& result, const Json::Value& partial)
+    {
+        for (const auto& name: partial.getMemberNames()) {
+            if (name == "parameters" && partial[name].isObject()) {
+                for (const auto& parameter: partial[name].getMemberNames()) {
+                    result[name][parameter] = partial[name][parameter];
+                }
+                continue;
+            }
+
+            result[name] = partial[name];
+        }
+    }
+
+    uint16_t GetRegistersCount(const std::string& format)
+    {
+        if (format == "u64" || format == "s64" || format == "double") {
+            return 4;
+        }
+
+        if (format == "u32" || format == "s32" || format == "u24" || format == "s24" || format == "float" ||
+            format == "bcd24" || format == "bcd32")
+        {
+            return 2;
+        }
+
+        return 1;
+    }
+
+    // Removes parameters stored in registers which the device doesn't support, they were read as zeros
+    void RemoveExcludedParameters(const THelper& helper, const TWASMPort::TReadLimits& limits, Json::Value& result)
+    {
+        if (!helper.Template || limits.Excluded.empty() || !result["parameters"].isObject()) {
+            return;
+        }
+
+        // parameters of a template are an object with ids as keys or an array
+        const auto& parameters = helper.Template->GetTemplate()["parameters"];
+
+        for (auto it = parameters.begin(); it != parameters.end(); ++it) {
+            const auto& parameter = *it;
+            auto function = READ_FUNCTIONS.find(parameter.get("reg_type", "holding").asString());
+            auto id = parameters.isObject() ? it.name() : parameter["id"].asString();
+
+            if (function == READ_FUNCTIONS.end() || !result["parameters"].isMember(id)) {
+                continue;
+            }
+
+            uint16_t address;
+
+            try {
+                address = std::stoul(parameter["address"].asString(), nullptr, 0);
+            } catch (const std::exception&) {
+                continue;
+            }
+
+            for (uint16_t i = 0; i < GetRegistersCount(parameter.get("format", "u16").asString()); ++i) {
+                if (limits.Excluded.count(std::make_pair(function->second, static_cast<uint16_t>(address + i)))) {
+                    LOG(Warn) << "device " << helper.DeviceKey << " doesn't support parameter " << id;
+                    result["parameters"].removeMember(id);
+                    break;
+                }
+            }
+        }
+    }
+
+    // Reads parameters with the learned read limits. A read rejected by the device is bisected by the port, so only
+    // the failed block is split and registers which the device doesn't support are found. They are remembered for
+    // the session and their parameters are left out of the result.
+    bool RunLoadConfig(THelper& helper,
+                       const Json::Value& request,
+                       TRPCDeviceParametersCache& parametersCache,
+                       const WBMQTT::TMqttRpcServer::TResultCallback& onResult)
+    {
+        auto errorCode = WBMQTT::E_RPC_SERVER_ERROR;
+        std::string errorMessage;
+        bool failed = false;
+
+        auto onError = [&](const WBMQTT::TMqttRpcErrorCode& code, const std::string& message) {
+            errorCode = code;
+            errorMessage = message;
+            failed = true;
+        };
+
+        auto onLoaded = [&helper, &onResult](const Json::Value& result) {
+            auto filtered = result;
+            RemoveExcludedParameters(helper, WASMPort->GetReadLimits(), filtered);
+            onResult(filtered);
+        };
+
+        auto rpcRequest = ParseRPCDeviceLoadConfigRequest(request,
+                                                          helper.Params,
+                                                          helper.Device,
+                                                          helper.Template,
+                                                          false,
+                                                          parametersCache,
+                                                          onLoaded,
+                                                          onError);
+        auto accessHandler = helper.GetAccessHandler();
+
+        WASMPort->StartReadSplitting(std::stoul(request["slave_id"].asString(), nullptr, 0), helper.Limits);
+
+        try {
+            TRPCDeviceLoadConfigSerialClientTask(rpcRequest).Run(Port, accessHandler, PolledDevices);
+        } catch (...) {
+            WASMPort->StopReadSplitting();
+            throw;
+        }
+
+        WASMPort->StopReadSplitting();
+
+        helper.Limits = WASMPort->GetReadLimits();
+        LearnedReadLimits[helper.DeviceKey] = helper.Limits;
+
+        if (failed) {
+            OnError(errorCode, errorMessage);
+            return false;
+        }
+
+        return true;
+    }
+
+    TSerialPortConnectionSettings GetPortSettings(const Json::Value& request)
+    {
+        auto parity = request.get("parity", "N").asString();
+        return TSerialPortConnectionSettings(request["baud_rate"].asInt(),
+                                             parity.empty() ? 'N' : parity[0],
+                                             request.get("data_bits", 8).asInt(),
+                                             request.get("stop_bits", 2).asInt());
+    }
+
+    // Stops monitoring, the monitored device is asked to stop sending events first
+    void StopMonitor()
+    {
+        if (!Monitor) {
+            return;
+        }
+
+        WASMPort->ApplySerialPortSettings(GetPortSettings(MonitorRequest));
+        Monitor->DisableEvents(*Port);
+        Monitor.reset();
+        MonitorRequest = Json::Value();
+    }
+
+    // Probes slave ids one by one. A silent slave id is dismissed as soon as the line stays idle for the time of
+    // the request, the reply and the device delay.
+    std::vector<int> ProbeSlaveIds(int first, int last)
+    {
+        std::vector<int> found;
+        auto frameTimeout = WASMPort->GetSendTimeBytes(3.5);
+
+        for (auto slaveId = first; slaveId <= last; ++slaveId) {
+            std::vector<uint8_t> frame{static_cast<uint8_t>(slaveId), CLASSIC_SCAN_FUNCTION, 0, 0, 0, 1};
+            ModbusRTU::AppendCRC(frame);
+
+            // gateways add network latency and their own line time, which isn't known here
+            auto timeout = Transport == SERIAL_TRANSPORT
+                               ? CLASSIC_SCAN_REPLY_DELAY +
+                                     WASMPort->GetSendTimeBytes(frame.size() + CLASSIC_SCAN_REPLY_SIZE)
+                               : duration_cast<microseconds>(CLASSIC_SCAN_GATEWAY_TIMEOUT);
+
+            WASMPort->WriteBytes(frame.data(), frame.size());
+            auto reply = WASMPort->ReadReply(CLASSIC_SCAN_REPLY_SIZE, timeout, frameTimeout);
+
+            if (!reply.empty() && reply[0] == slaveId && ModbusRTU::IsValidFrame(reply.data(), reply.size())) {
+                found.push_back(slaveId);
+            }
+        }
+
+        return found;
+    }
+
+    // Modbus TCP gateways match replies to requests by transaction ids, so probes are sent in batches and replies of
+    // a batch are collected until every slave id replies or the gateway stays silent for its timeout. Gateways queue
+    // only a few requests, a larger batch would be dropped by them.
+    std::vector<int> ProbeSlaveIdsPipelined(int first, int last)
+    {
+        std::vector<int> found;
+
+        // RTU reply without slave id and CRC after MBAP header
+        const auto replySize = ModbusTCP::HEADER_SIZE + CLASSIC_SCAN_REPLY_SIZE - 3;
+
+        for (auto batchFirst = first; batchFirst <= last; batchFirst += MAX_PIPELINED_REQUESTS) {
+            std::vector<uint8_t> requests;
+            std::vector<uint8_t> buffer;
+            std::set<int> pending;
+
+            for (auto slaveId = batchFirst; slaveId <= std::min(batchFirst + MAX_PIPELINED_REQUESTS - 1, last);
+                 ++slaveId)
+            {
+                auto frame = ModbusTCP::MakeFrame(slaveId, slaveId, {CLASSIC_SCAN_FUNCTION, 0, 0, 0, 1});
+                requests.insert(requests.end(), frame.begin(), frame.end());
+                pending.insert(slaveId);
+            }
+
+            WASMPort->WriteBytes(requests.data(), requests.size());
+
+            while (!pending.empty()) {
+                auto reply = WASMPort->ReadReply(pending.size() * replySize,
+                                                 duration_cast<microseconds>(CLASSIC_SCAN_GATEWAY_TIMEOUT),
+                                                 PIPELINE_FRAME_TIMEOUT);
+
+                if (reply.empty()) {
+                    break;
+                }
+
+                buffer.insert(buffer.end(), reply.begin(), reply.end());
+
+                while (auto size = ModbusTCP::GetFrameSize(buffer.data(), buffer.size())) {
+                    auto slaveId = ModbusTCP::GetTransactionId(buffer.data());
+                    auto function = size > ModbusTCP::HEADER_SIZE ? buffer[ModbusTCP::HEADER_SIZE] : 0;
+                    auto code = size > ModbusTCP::HEADER_SIZE + 1 ? buffer[ModbusTCP::HEADER_SIZE + 1] : 0;
+
+                    // gateway reports devices which didn't reply with "gateway path unavailable" and
+                    // "gateway target device failed to respond" exceptions
+                    auto gatewayError = (function & 0x80) && (code == 0x0A || code == 0x0B);
+
+                    if (pending.erase(slaveId) && !gatewayError) {
+                        found.push_back(slaveId);
+                    }
+
+                    buffer.erase(buffer.begin(), buffer.begin() + size);
+                }
+            }
+        }
+
+        std::sort(found.begin(), found.end());
+        return found;
+    }
+
+    // Finds devices without the fast scan extension by probing a range of slave ids with minimal read requests
+    Json::Value ClassicScan(const Json::Value& request)
+    {
+        auto settings = GetPortSettings(request);
+        WASMPort->ApplySerialPortSettings(settings);
+
+        auto first = request.get("first_slave_id", 1).asInt();
+        auto last = std::min(first + request.get("slave_ids_count", MAX_SLAVE_ID).asInt() - 1, MAX_SLAVE_ID);
+        auto found =
+            Transport == MODBUS_TCP_TRANSPORT ? ProbeSlaveIdsPipelined(first, last) : ProbeSlaveIds(first, last);
+        Json::Value devices(Json::arrayValue);
+
+        for (auto slaveId: found) {
+            LOG(Info) << "classic scan found slave id " << slaveId << " at " << settings.BaudRate;
+
+            // same format as fast scan results, devices without the extension have no serial number and signature
+            Json::Value device;
+            device["cfg"]["slave_id"] = slaveId;
+            device["cfg"]["baud_rate"] = settings.BaudRate;
+            device["cfg"]["data_bits"] = settings.DataBits;
+            device["cfg"]["parity"] = std::string(1, settings.Parity);
+            device["cfg"]["stop_bits"] = settings.StopBits;
+            device["device_signature"] = "";
+            device["fw"]["version"] = "";
+            device["fw_signature"] = "";
+            device["sn"] = "";
+            devices.append(device);
+        }
+
+        Json::Value result;
+        result["devices"] = devices;
+        return result;
+    }
+
+    bool HasUngroupedParameters(const Json::Value& deviceTemplate)
+    {
+        for (const auto& parameter: deviceTemplate["parameters"]) {
+            if (parameter.isObject() && !parameter.isMember("group")) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // Reads parameters group by group in the template order and reports every group as soon as it's read. Groups
+    // share the parameters cache, so conditions see values read with previous groups and the device is identified
+    // once. Parameters outside of top-level groups are read by the final pass without a group.
+    void StreamLoadConfig(THelper& helper)
+    {
+        std::vector<std::string> groups;
+        const auto& deviceTemplate = helper.Template->GetTemplate();
+
+        for (const auto& group: deviceTemplate["groups"]) {
+            if (!group.isMember("group") && group.isMember("id")) {
+                groups.push_back(group["id"].asString());
+            }
+        }
+
+        if (HasUngroupedParameters(deviceTemplate)) {
+            groups.emplace_back();
+        }
+
+        Json::Value result(Json::objectValue);
+        TRPCDeviceParametersCache parametersCache;
+
+        for (size_t i = 0; i < groups.size(); ++i) {
+            auto onResult = [&](const Json::Value& partial) {
+                MergeLoadConfigResult(result, partial);
+
+                Json::Value progress;
+                progress["group"] = groups[i];
+                progress["index"] = static_cast<Json::UInt>(i);
+                progress["count"] = static_cast<Json::UInt>(groups.size());
+                progress["result"] = partial;
+                OnProgress(progress);
+            };
+
+            auto request = helper.Request;
+
+            if (!groups[i].empty()) {
+                request["group"] = groups[i];
+            }
+
+            if (!RunLoadConfig(helper, request, parametersCache, onResult)) {
+                return;
+            }
+        }
+
+        OnResult(result);
+    }
+}
+
+void Init(const std::string& requestString)
+{
+    try {
+        Json::Value result;
+        result["finished"] = InitializeSlice(INIT_SLICE_TIME);
+        result["done"] = static_cast<Json::UInt>(
+            TemplatesUnpacker ? TemplatesUnpacker->GetUnpackedCount() : TemplatesCount);
+        result["total"] = static_cast<Json::UInt>(
+            TemplatesUnpacker ? TemplatesUnpacker->GetTotalCount() : TemplatesCount);
+        OnResult(result);
+    } catch (const std::exception& e) {
+        LOG(Error) << "init RPC failed: " << e.what();
+        OnError(WBMQTT::E_RPC_SERVER_ERROR, e.what());
+    }
 }
 
 void ConfigGetDeviceTypes(const std::string& requestString)
 {
     try {
-        THelper helper(requestString, std::string(), "config/GetDeviceTypes");
-        OnResult(ConfigHandler->GetDeviceTypes(helper.Request));
+        auto request = ParseJson(requestString);
+        auto lang = request["lang"].asString();
+
+        SendCachedReply("config/GetDeviceTypes:" + lang, [&request, &lang]() {
+            auto reply = MakePrecomputedReply(Precomputed::GetDeviceTypesPath(lang));
+
+            if (reply.empty()) {
+                reply = SerializeResult(GetConfigHandler().GetDeviceTypes(request));
+            }
+
+            return reply;
+        });
     } catch (const std::exception& e) {
         LOG(Error) << "config/GetDeviceTypes RPC failed: " << e.what();
+        OnError(WBMQTT::E_RPC_SERVER_ERROR, e.what());
     }
 }
 
 void ConfigGetSchema(const std::string& requestString)
 {
     try {
-        THelper helper(requestString, std::string(), "config/GetSchema");
-        OnResult(ConfigHandler->GetSchema(helper.Request));
+        auto request = ParseJson(requestString);
+        auto deviceType = request["type"].asString();
+
+        // clients with the current common schema get schemas without common definitions
+        auto removeCommon = request["common_version"].asString() == GetCommonSchemaVersion();
+        auto key = "config/GetSchema:" + deviceType + (removeCommon ? ":delta" : "");
+
+        SendCachedReply(key, [&request, &deviceType, removeCommon]() {
+            std::string precomputed;
+            Json::Value schema;
+
+            if (Precomputed::Read(Precomputed::GetSchemaPath(deviceType), precomputed)) {
+                ++PrecomputedSchemas;
+
+                if (!removeCommon) {
+                    return "{\"error\":null,\"result\":" + precomputed + "}";
+                }
+
+                schema = ParseJson(precomputed);
+            } else {
+                // custom templates have no precomputed schema
+                LOG(Debug) << "no precomputed schema of " << deviceType << ", it's generated";
+                ++GeneratedSchemas;
+                schema = GetConfigHandler().GetSchema(request);
+            }
+
+            if (removeCommon) {
+                RemoveCommonDefinitions(schema);
+            }
+
+            return SerializeResult(schema);
+        });
     } catch (const std::exception& e) {
         LOG(Error) << "config/GetSchema RPC failed: " << e.what();
+        OnError(WBMQTT::E_RPC_SERVER_ERROR, e.what());
+    }
+}
+
+void ConfigMatchDeviceTypes(const std::string& requestString)
+{
+    try {
+        auto request = ParseJson(requestString);
+
+        // device signatures don't depend on the language
+        if (!DeviceTypesIndex) {
+            std::string deviceTypes;
+
+            if (Precomputed::Read(Precomputed::GetDeviceTypesPath("en"), deviceTypes)) {
+                DeviceTypesIndex = std::make_unique<TDeviceTypesIndex>(ParseJson(deviceTypes));
+            } else {
+                Json::Value deviceTypesRequest;
+                deviceTypesRequest["lang"] = "en";
+                DeviceTypesIndex =
+                    std::make_unique<TDeviceTypesIndex>(GetConfigHandler().GetDeviceTypes(deviceTypesRequest));
+            }
+        }
+
+        Json::Value result(Json::arrayValue);
+
+        for (const auto& device: request["devices"]) {
+            Json::Value types(Json::arrayValue);
+
+            for (const auto& type:
+                 DeviceTypesIndex->Find(device["device_signature"].asString(), device["fw"].asString()))
+            {
+                types.append(type);
+            }
+
+            result.append(types);
+        }
+
+        OnResult(result);
+    } catch (const std::exception& e) {
+        LOG(Error) << "config/MatchDeviceTypes RPC failed: " << e.what();
+        OnError(WBMQTT::E_RPC_SERVER_ERROR, e.what());
+    }
+}
+
+void ConfigGetCommonSchema(const std::string& requestString)
+{
+    try {
+        SendCachedReply("config/GetCommonSchema", []() {
+            Json::Value result;
+            result["version"] = GetCommonSchemaVersion();
+            result["definitions"] = GetCommonSchema()["definitions"];
+            return SerializeResult(result);
+        });
+    } catch (const std::exception& e) {
+        LOG(Error) << "config/GetCommonSchema RPC failed: " << e.what();
+        OnError(WBMQTT::E_RPC_SERVER_ERROR, e.what());
     }
 }
 
@@ -190,10 +951,97 @@ void PortScan(const std::string& requestString)
 {
     try {
         THelper helper(requestString, PORT_SCAN_SCHEMA_FILE, "port/Scan");
+
+        if (helper.Request["mode"] == "classic") {
+            OnResult(ClassicScan(helper.Request));
+            return;
+        }
+
         auto accessHandler = helper.GetAccessHandler();
         TRPCPortScanSerialClientTask(helper.Request, OnResult, OnError).Run(Port, accessHandler, PolledDevices);
     } catch (const std::exception& e) {
         LOG(Error) << "port/Scan RPC failed: " << e.what();
+        OnError(WBMQTT::E_RPC_SERVER_ERROR, e.what());
+    }
+}
+
+// Listens to traffic of another master at the given line settings and scores them by the part of bytes forming
+// valid Modbus RTU frames, so the scan can start at the settings used on the bus
+void PortSniff(const std::string& requestString)
+{
+    try {
+        auto request = ParseJson(requestString);
+        auto duration = request.isMember("duration") ? milliseconds(request["duration"].asInt()) : SNIFF_DURATION;
+        auto settings = GetPortSettings(request);
+        WASMPort->ApplySerialPortSettings(settings);
+
+        auto stats = ModbusRTU::AnalyzeTraffic(WASMPort->Listen(duration));
+        LOG(Info) << "port/Sniff at " << settings.BaudRate << " " << settings.DataBits << settings.Parity
+                  << settings.StopBits << ": " << stats.Frames << " frames in " << stats.Bytes << " bytes";
+
+        Json::Value result;
+        result["bytes"] = static_cast<Json::UInt>(stats.Bytes);
+        result["frames"] = static_cast<Json::UInt>(stats.Frames);
+        result["score"] = stats.GetScore();
+        result["slave_ids"] = Json::Value(Json::arrayValue);
+
+        for (auto slaveId: stats.SlaveIds) {
+            result["slave_ids"].append(slaveId);
+        }
+
+        OnResult(result);
+    } catch (const std::exception& e) {
+        LOG(Error) << "port/Sniff RPC failed: " << e.what();
+        OnError(WBMQTT::E_RPC_SERVER_ERROR, e.what());
+    }
+}
+
+// Writes a firmware file stored in the module file system by the page to a device through its bootloader
+void FirmwareUpdate(const std::string& requestString)
+{
+    try {
+        auto request = ParseJson(requestString);
+
+        if (Transport == MODBUS_TCP_TRANSPORT) {
+            throw std::runtime_error("firmware update isn't supported over Modbus TCP");
+        }
+
+        auto path = request["file"].asString();
+        auto firmware = ReadFile(path);
+        unlink(path.c_str());
+
+        TFirmwareUpdater updater(*WASMPort, request["slave_id"].asInt(), firmware);
+
+        if (!request["in_bootloader"].asBool()) {
+            updater.RebootToBootloader(GetPortSettings(request));
+        }
+
+        auto baudRates = request.isMember("bootloader_baud_rate")
+                             ? std::vector<int>{request["bootloader_baud_rate"].asInt()}
+                             : BOOTLOADER_BAUD_RATES;
+        auto bootloaderSettings = updater.FindBootloaderSettings(baudRates);
+        TFirmwareUpdater::TProgress last;
+
+        updater.Write(bootloaderSettings, [&last](const TFirmwareUpdater::TProgress& progress) {
+            Json::Value value;
+            value["written"] = static_cast<Json::UInt>(progress.Written);
+            value["total"] = static_cast<Json::UInt>(progress.Total);
+            value["speed"] = progress.Speed;
+            OnProgress(value);
+            last = progress;
+        });
+
+        // read limits learned for the old firmware aren't valid anymore
+        EraseSlaveEntries(LearnedReadLimits, request["slave_id"].asString());
+
+        Json::Value result;
+        result["written"] = static_cast<Json::UInt>(last.Written);
+        result["speed"] = last.Speed;
+        result["baud_rate"] = bootloaderSettings.BaudRate;
+        OnResult(result);
+    } catch (const std::exception& e) {
+        LOG(Error) << "fw/Update RPC failed: " << e.what();
+        OnError(WBMQTT::E_RPC_SERVER_ERROR, e.what());
     }
 }
 
@@ -201,45 +1049,338 @@ void DeviceLoadConfig(const std::string& requestString)
 {
     try {
         THelper helper(requestString, DEVICE_LOAD_CONFIG_SCHEMA_FILE, "device/LoadConfig", true);
+
+        if (helper.Template && helper.Request["stream"].asBool() && !helper.Request.isMember("group") &&
+            helper.Template->GetTemplate()["groups"].size())
+        {
+            StreamLoadConfig(helper);
+            return;
+        }
+
         TRPCDeviceParametersCache parametersCache;
-        auto rpcRequest = ParseRPCDeviceLoadConfigRequest(helper.Request,
-                                                          helper.Params,
-                                                          helper.Device,
-                                                          helper.Template,
-                                                          false,
-                                                          parametersCache,
-                                                          OnResult,
-                                                          OnError);
-        auto accessHandler = helper.GetAccessHandler();
-        TRPCDeviceLoadConfigSerialClientTask(rpcRequest).Run(Port, accessHandler, PolledDevices);
+        RunLoadConfig(helper, helper.Request, parametersCache, OnResult);
     } catch (const std::exception& e) {
         LOG(Error) << "device/LoadConfig RPC failed: " << e.what();
+        OnError(WBMQTT::E_RPC_SERVER_ERROR, e.what());
     }
 }
 
+// Writes parameters and channels. Writes of wb-mqtt-serial are collected by the port and sent after the request is
+// handled, consecutive writes to adjacent registers in one request. With skip_unchanged registers which already hold
+// the values aren't written. It's ignored for requests with channels, they may be commands which act on every write.
 void DeviceSet(const std::string& requestString)
 {
     try {
         THelper helper(requestString, DEVICE_SET_SCHEMA_FILE, "device/Set", true);
+
+        Json::Value result;
+        auto errorCode = WBMQTT::E_RPC_SERVER_ERROR;
+        std::string errorMessage;
+        bool failed = false;
+
+        auto onResult = [&result](const Json::Value& value) { result = value; };
+
+        auto onError = [&](const WBMQTT::TMqttRpcErrorCode& code, const std::string& message) {
+            errorCode = code;
+            errorMessage = message;
+            failed = true;
+        };
+
         auto rpcRequest = ParseRPCDeviceSetRequest(helper.Request,
                                                    helper.Params,
                                                    helper.Device,
                                                    helper.Template,
                                                    false,
-                                                   OnResult,
-                                                   OnError);
+                                                   onResult,
+                                                   onError);
         auto accessHandler = helper.GetAccessHandler();
-        TRPCDeviceSetSerialClientTask(rpcRequest).Run(Port, accessHandler, PolledDevices);
+
+        auto skipUnchanged = helper.Request.get("skip_unchanged", false).asBool() &&
+                             helper.Request.get("channels", Json::Value()).empty();
+        WASMPort->StartWriteCoalescing(std::stoul(helper.Request["slave_id"].asString(), nullptr, 0),
+                                       helper.Limits,
+                                       skipUnchanged);
+
+        try {
+            TRPCDeviceSetSerialClientTask(rpcRequest).Run(Port, accessHandler, PolledDevices);
+        } catch (...) {
+            WASMPort->StopWriteCoalescing();
+            throw;
+        }
+
+        // nothing is written if the request fails before the writes are sent
+        if (failed) {
+            WASMPort->StopWriteCoalescing();
+            OnError(errorCode, errorMessage);
+            return;
+        }
+
+        WASMPort->FinishWriteCoalescing();
+        OnResult(result);
     } catch (const std::exception& e) {
         LOG(Error) << "device/Set RPC failed: " << e.what();
+        OnError(WBMQTT::E_RPC_SERVER_ERROR, e.what());
+    }
+}
+
+// Starts monitoring of channels of a device, values are read by following monitor/Poll requests
+void MonitorStart(const std::string& requestString)
+{
+    try {
+        THelper helper(requestString, "", "monitor/Start", true);
+
+        // the page starts the monitor of another device without stopping the previous one
+        StopMonitor();
+
+        if (!helper.Device) {
+            throw std::runtime_error("unknown device type " + helper.Request["device_type"].asString());
+        }
+
+        Monitor = std::make_unique<TChannelMonitor>(helper.Device,
+                                                    helper.Params,
+                                                    helper.Template->GetTemplate(),
+                                                    helper.Request["channels"],
+                                                    MONITOR_INTERVAL);
+        MonitorRequest = helper.Request;
+
+        Json::Value result;
+        result["channels"] = Json::Value(Json::arrayValue);
+
+        for (const auto& name: Monitor->GetChannelNames()) {
+            result["channels"].append(name);
+        }
+
+        OnResult(result);
+    } catch (const std::exception& e) {
+        LOG(Error) << "monitor/Start RPC failed: " << e.what();
+        OnError(WBMQTT::E_RPC_SERVER_ERROR, e.what());
+    }
+}
+
+// Reads due channels of the monitored device, returns changed values and the delay until the next poll
+void MonitorPoll(const std::string& requestString)
+{
+    try {
+        if (!Monitor) {
+            throw std::runtime_error("monitor isn't started");
+        }
+
+        auto request = ParseJson(requestString);
+        auto defaultBudget = MonitorRequest.get("budget", static_cast<Json::Int64>(MONITOR_BUDGET.count()));
+        auto budget = milliseconds(request.get("budget", defaultBudget).asInt());
+
+        WASMPort->ApplySerialPortSettings(GetPortSettings(MonitorRequest));
+
+        auto result = Monitor->Poll(*Port, budget);
+        result["next"] = static_cast<Json::Int64>(Monitor->GetNextPollDelay().count());
+        OnResult(result);
+    } catch (const std::exception& e) {
+        LOG(Error) << "monitor/Poll RPC failed: " << e.what();
+        OnError(WBMQTT::E_RPC_SERVER_ERROR, e.what());
+    }
+}
+
+void MonitorStop(const std::string& requestString)
+{
+    try {
+        StopMonitor();
+        OnResult(Json::Value(Json::objectValue));
+    } catch (const std::exception& e) {
+        LOG(Error) << "monitor/Stop RPC failed: " << e.what();
+        Monitor.reset();
+        OnError(WBMQTT::E_RPC_SERVER_ERROR, e.what());
     }
 }
 
+// Writes the trace recorded since traceStart to a file in the module file system, the page downloads it from there
+void TraceSave(const std::string& requestString)
+{
+    try {
+        auto request = ParseJson(requestString);
+        auto path = request["file"].asString();
+        auto trace = WASMPort->GetTrace();
+
+        if (trace.empty()) {
+            throw std::runtime_error("trace isn't recorded");
+        }
+
+        std::ofstream file(path, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(trace.data()), trace.size());
+
+        if (!file) {
+            throw std::runtime_error("can't write trace file " + path);
+        }
+
+        Json::Value result;
+        result["file"] = path;
+        result["size"] = static_cast<Json::UInt>(trace.size());
+        OnResult(result);
+    } catch (const std::exception& e) {
+        LOG(Error) << "trace/Save RPC failed: " << e.what();
+        OnError(WBMQTT::E_RPC_SERVER_ERROR, e.what());
+    }
+}
+
+// Replaces the port with one replaying a recorded trace, returns recorded RPC requests to send again with their
+// time since the trace start in milliseconds
+void ReplayStart(const std::string& requestString)
+{
+    try {
+        auto request = ParseJson(requestString);
+
+        auto trace = ReadFile(request["file"].asString());
+        ReplayPort = std::make_shared<TReplayPort>(std::move(trace), request.get("speed", 1).asDouble());
+        Transport = SERIAL_TRANSPORT;
+        WASMPort = ReplayPort;
+        Port = std::make_shared<TFeaturePort>(WASMPort, false);
+
+        // state learned from the real bus would make the replay go another way
+        Monitor.reset();
+        LearnedReadLimits.clear();
+
+        Json::Value result;
+        result["requests"] = Json::Value(Json::arrayValue);
+
+        for (const auto& record: ReplayPort->GetRequests()) {
+            Json::Value item;
+            item["time"] = record.Time.count() / 1000.0;
+            item["type"] = record.Name;
+            item["data"] = record.Data;
+            result["requests"].append(item);
+        }
+
+        OnResult(result);
+    } catch (const std::exception& e) {
+        LOG(Error) << "replay/Start RPC failed: " << e.what();
+        OnError(WBMQTT::E_RPC_SERVER_ERROR, e.what());
+    }
+}
+
+void ReplayStats(const std::string& requestString)
+{
+    try {
+        if (!ReplayPort) {
+            throw std::runtime_error("replay isn't started");
+        }
+
+        auto stats = ReplayPort->GetReplayStats();
+
+        Json::Value result;
+        result["operations"] = static_cast<Json::UInt>(stats.Operations);
+        result["mismatches"] = static_cast<Json::UInt>(stats.Mismatches);
+        result["missing"] = static_cast<Json::UInt>(stats.Missing);
+        result["schemas_precomputed"] = static_cast<Json::UInt>(PrecomputedSchemas);
+        result["schemas_generated"] = static_cast<Json::UInt>(GeneratedSchemas);
+        OnResult(result);
+    } catch (const std::exception& e) {
+        LOG(Error) << "replay/Stats RPC failed: " << e.what();
+        OnError(WBMQTT::E_RPC_SERVER_ERROR, e.what());
+    }
+}
+
+// Returns heap usage of the module instance: allocated, free and peak bytes of the heap, the heap size and the size
+// of the wasm memory, with sizes of caches and the trace
+void HeapStats(const std::string& requestString)
+{
+    try {
+        auto info = mallinfo();
+
+        Json::Value result;
+        result["used"] = static_cast<Json::UInt64>(info.uordblks);
+        result["free"] = static_cast<Json::UInt64>(info.fordblks);
+        result["size"] = static_cast<Json::UInt64>(info.arena);
+        result["footprint"] = static_cast<Json::UInt64>(info.usmblks);
+        result["memory"] = static_cast<Json::UInt64>(emscripten_get_heap_size());
+        result["memory_max"] = static_cast<Json::UInt64>(emscripten_get_heap_max());
+        result["budget"] = static_cast<Json::UInt64>(HeapBudget);
+        result["reply_cache"] = static_cast<Json::UInt64>(ReplyCache.GetSize());
+        result["trace"] = static_cast<Json::UInt64>(WASMPort->GetTraceSize());
+        OnResult(result);
+    } catch (const std::exception& e) {
+        LOG(Error) << "heap/Stats RPC failed: " << e.what();
+        OnError(WBMQTT::E_RPC_SERVER_ERROR, e.what());
+    }
+}
+
+void SetReplyCacheSize(size_t size)
+{
+    ReplyCache.SetMaxSize(size);
+}
+
+// Selects the transport of the module instance, it must be done before any request
+void SetTransport(const std::string& transport)
+{
+    if (transport != SERIAL_TRANSPORT && transport != RTU_OVER_TCP_TRANSPORT && transport != MODBUS_TCP_TRANSPORT) {
+        LOG(Error) << "unknown transport: " << transport;
+        return;
+    }
+
+    Transport = transport;
+
+    if (Transport == SERIAL_TRANSPORT) {
+        WASMPort = std::make_shared<TWASMPort>();
+    } else {
+        WASMPort = std::make_shared<TWASMSocketPort>(Transport == MODBUS_TCP_TRANSPORT);
+    }
+
+    Port = std::make_shared<TFeaturePort>(WASMPort, Transport == MODBUS_TCP_TRANSPORT);
+}
+
+void SetTransactEnabled(bool enabled)
+{
+    WASMPort->SetTransactEnabled(enabled);
+}
+
+// Returns allocated and free bytes of the heap and the heap size, the page logs their change by each request
+emscripten::val GetHeapUsage()
+{
+    auto info = mallinfo();
+    auto usage = emscripten::val::object();
+    usage.set("used", info.uordblks);
+    usage.set("free", info.fordblks);
+    usage.set("size", info.arena);
+    return usage;
+}
+
+void SetHeapBudget(size_t budget)
+{
+    HeapBudget = budget;
+}
+
+void TraceStart()
+{
+    WASMPort->StartTrace();
+}
+
+void TraceRequest(const std::string& name, const std::string& data)
+{
+    WASMPort->TraceRequest(name, data);
+}
+
 EMSCRIPTEN_BINDINGS(module)
 {
+    emscripten::function("init", &Init);
     emscripten::function("configGetDeviceTypes", &ConfigGetDeviceTypes);
     emscripten::function("configGetSchema", &ConfigGetSchema);
+    emscripten::function("configGetCommonSchema", &ConfigGetCommonSchema);
+    emscripten::function("configMatchDeviceTypes", &ConfigMatchDeviceTypes);
     emscripten::function("portScan", &PortScan);
+    emscripten::function("portSniff", &PortSniff);
     emscripten::function("deviceLoadConfig", &DeviceLoadConfig);
     emscripten::function("deviceSet", &DeviceSet);
+    emscripten::function("firmwareUpdate", &FirmwareUpdate);
+    emscripten::function("monitorStart", &MonitorStart);
+    emscripten::function("monitorPoll", &MonitorPoll);
+    emscripten::function("monitorStop", &MonitorStop);
+    emscripten::function("traceSave", &TraceSave);
+    emscripten::function("replayStart", &ReplayStart);
+    emscripten::function("replayStats", &ReplayStats);
+    emscripten::function("heapStats", &HeapStats);
+    emscripten::function("setReplyCacheSize", &SetReplyCacheSize);
+    emscripten::function("setHeapBudget", &SetHeapBudget);
+    emscripten::function("setTransactEnabled", &SetTransactEnabled);
+    emscripten::function("setTransport", &SetTransport);
+    emscripten::function("traceStart", &TraceStart);
+    emscripten::function("traceRequest", &TraceRequest);
+    emscripten::function("getHeapUsage", &GetHeapUsage);
 }
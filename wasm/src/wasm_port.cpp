@@ -1,21 +1,90 @@
 #include "wasm_port.h"
 #include "log.h"
+#include "serial_exc.h"
+#include "wasm_modbus.h"
 
 #include <wblib/utils.h>
 
+#include <algorithm>
+#include <cmath>
+
 #include <emscripten/emscripten.h>
+#include <emscripten/heap.h>
 #include <emscripten/val.h>
 
 #define LOG(logger) logger.Log() << "[wasm port] "
 
-TWASMPort::TWASMPort()
+namespace
+{
+    // reply delay of a device can't be shorter than the latency timer of a USB adapter, the longest one is the
+    // delay used by serial.js without an estimate
+    const auto MIN_REPLY_DELAY = std::chrono::milliseconds(20);
+    const auto MAX_REPLY_DELAY = std::chrono::milliseconds(250);
+
+    // recording left on for a long session stops at a sixteenth of the largest heap not to exhaust it
+    const size_t MAX_TRACE_SIZE = emscripten_get_heap_max() / 16;
+
+    // exception codes of a read which the device may accept if it's split
+    const uint8_t EXCEPTION_FLAG = 0x80;
+    const uint8_t ILLEGAL_DATA_ADDRESS = 2;
+    const uint8_t ILLEGAL_DATA_VALUE = 3;
+
+    // RTU read request is slave id, function, address, count and CRC, single writes have the same size
+    const size_t READ_REQUEST_SIZE = 8;
+
+    const uint8_t WRITE_COIL = 5;
+    const uint8_t WRITE_REGISTER = 6;
+    const uint8_t WRITE_COILS = 15;
+    const uint8_t WRITE_REGISTERS = 16;
+    const uint16_t COIL_ON = 0xFF00;
+
+    // largest multiple writes allowed by Modbus
+    const uint16_t MAX_WRITE_COILS = 1968;
+    const uint16_t MAX_WRITE_REGISTERS = 123;
+
+    // read functions under which written coils and registers are collected
+    const uint8_t READ_COILS = 1;
+    const uint8_t READ_HOLDING = 3;
+
+    bool IsBitFunction(uint8_t function)
+    {
+        return function == 1 || function == 2;
+    }
+
+    // JS timers have millisecond resolution, timeouts are rounded up not to become zero
+    int ToMilliseconds(const std::chrono::microseconds& time)
+    {
+        return static_cast<int>((time.count() + 999) / 1000);
+    }
+
+    // Copies data left by the last receive operation in Module.serial.received
+    std::vector<uint8_t> TakeReceived(size_t length)
+    {
+        std::vector<uint8_t> data(length);
+
+        // clang-format off
+        EM_ASM(
+        {
+            HEAPU8.set(Module.serial.received, $0);
+            delete Module.serial.received;
+        },
+        data.data());
+        // clang-format on
+
+        return data;
+    }
+}
+
+TWASMPort::TWASMPort(): ResponseTimeouts(MIN_REPLY_DELAY, MAX_REPLY_DELAY)
 {}
 
 void TWASMPort::Open()
 {}
 
 void TWASMPort::Close()
-{}
+{
+    Flush();
+}
 
 bool TWASMPort::IsOpen() const
 {
@@ -26,22 +95,156 @@ void TWASMPort::CheckPortOpen() const
 {}
 
 void TWASMPort::WriteBytes(const uint8_t* buffer, int count)
+{
+    LOG(Debug) << "write " << count << " bytes: " << WBMQTT::HexDump(buffer, count);
+
+    // the request is sent by the following read, so the stack is suspended once per transaction
+    Flush();
+    PendingWrite.assign(buffer, buffer + count);
+
+    if (!TransactEnabled) {
+        Flush();
+    }
+}
+
+void TWASMPort::Flush()
+{
+    if (PendingWrite.empty()) {
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    BusWrite(PendingWrite);
+    CountCrossing(start);
+
+    if (IsTracing()) {
+        TraceWriter->AddWrite(PendingWrite);
+    }
+
+    PendingWrite.clear();
+}
+
+std::vector<uint8_t> TWASMPort::Receive(size_t count, int timeout, int frameGap)
+{
+    auto requestSize = PendingWrite.size();
+    uint8_t slaveId = requestSize ? GetSlaveId(PendingWrite) : 0;
+
+    if (requestSize && !timeout) {
+        auto delay = ResponseTimeouts.GetDelay(slaveId);
+
+        if (delay.count()) {
+            timeout = ToMilliseconds(GetSendTimeBytes(requestSize + count) + delay);
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto data = BusExchange(PendingWrite, count, timeout, frameGap);
+    CountCrossing(start);
+
+    auto rtt = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+    if (IsTracing()) {
+        TraceWriter->AddExchange(PendingWrite, count, timeout, frameGap, data, rtt);
+    }
+
+    PendingWrite.clear();
+    ++Stats.Transactions;
+
+    if (requestSize) {
+        if (!data.empty()) {
+            auto transferTime = GetSendTimeBytes(requestSize + data.size());
+            ResponseTimeouts.AddSample(slaveId, std::max(rtt - transferTime, std::chrono::microseconds::zero()));
+        } else {
+            ResponseTimeouts.AddTimeout(slaveId);
+        }
+    }
+
+    return data;
+}
+
+void TWASMPort::BusSetOptions(const TSerialPortConnectionSettings& settings)
+{
+    // clang-format off
+    EM_ASM(
+    {
+        Module.serial.setOptions($0, $1, $2, $3);
+    },
+    settings.BaudRate, settings.DataBits, settings.Parity, settings.StopBits);
+    // clang-format on
+}
+
+void TWASMPort::BusWrite(const std::vector<uint8_t>& data)
 {
     // clang-format off
     EM_ASM(
     {
-        let data = new Uint8Array($1);
+        let data = HEAPU8.slice($0, $0 + $1);
+        Asyncify.handleAsync(async() => { await Module.serial.measure(() => Module.serial.write(data)); });
+    },
+    data.data(), data.size());
+    // clang-format on
+}
 
-        for (let i = 0; i < $1; ++i) {
-            data[i] = getValue($0 + i, 'i8');
-        }
+std::vector<uint8_t> TWASMPort::BusExchange(const std::vector<uint8_t>& request,
+                                            size_t count,
+                                            int timeout,
+                                            int frameGap)
+{
+    // clang-format off
+    auto length = EM_ASM_INT(
+    {
+        let data = $3 ? HEAPU8.slice($2, $2 + $3) : null;
+        let timeout = $1 || undefined;
 
-        Asyncify.handleAsync(async() => { await Module.serial.write(data); });
+        let result = Asyncify.handleAsync(async() => {
+            return await Module.serial.measure(() => {
+                return data ? Module.serial.transact(data, $0, timeout, $4) : Module.serial.read($0, timeout, $4);
+            });
+        });
+
+        Module.serial.received = result instanceof Uint8Array ? result : new Uint8Array();
+        return Module.serial.received.length;
     },
-    buffer, count);
+    count, timeout, request.data(), request.size(), frameGap);
     // clang-format on
 
-    LOG(Debug) << "write " << count << " bytes: " << WBMQTT::HexDump(buffer, count);
+    return TakeReceived(length);
+}
+
+std::vector<uint8_t> TWASMPort::BusListen(int duration)
+{
+    // clang-format off
+    auto length = EM_ASM_INT(
+    {
+        let result = Asyncify.handleAsync(async() => {
+            return await Module.serial.measure(() => Module.serial.listen($0));
+        });
+        Module.serial.received = result instanceof Uint8Array ? result : new Uint8Array();
+        return Module.serial.received.length;
+    },
+    duration);
+    // clang-format on
+
+    return TakeReceived(length);
+}
+
+double TWASMPort::BusTakeIoTime()
+{
+    // clang-format off
+    return EM_ASM_DOUBLE(
+    {
+        let time = Module.serial.ioTime;
+        Module.serial.ioTime = 0;
+        return time;
+    });
+    // clang-format on
+}
+
+void TWASMPort::CountCrossing(const std::chrono::steady_clock::time_point& start)
+{
+    ++Stats.Crossings;
+    Stats.CrossingTime +=
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
 }
 
 uint8_t TWASMPort::ReadByte(const std::chrono::microseconds& timeout)
@@ -55,49 +258,51 @@ TReadFrameResult TWASMPort::ReadFrame(uint8_t* buffer,
                                       const std::chrono::microseconds& frameTimeout,
                                       TFrameCompletePred frame_complete)
 {
-    // clang-format off
-    auto length = EM_ASM_INT(
-    {
-        let result = Asyncify.handleAsync(async() => { return await Module.serial.read($1); });
+    auto data = CollectWrite();
 
-        if (!(result instanceof Uint8Array)) {
-            return 0;
+    if (data.empty()) {
+        if (!CollectedWrites.empty()) {
+            // the request may depend on the written values
+            auto request = std::move(PendingWrite);
+            PendingWrite.clear();
+            SendWrites();
+            PendingWrite = std::move(request);
         }
 
-        for (let i = 0; i < result.length; ++i) {
-            setValue($0 + i, result[i], 'i8');
-        }
-
-        return result.length;
-    },
-    buffer, count);
-    // clang-format on
+        data = ReadRegisters(count);
+    }
 
-    if (!length) {
-        throw std::runtime_error("request timed out");
+    if (data.empty()) {
+        throw TResponseTimeoutException();
     }
 
     TReadFrameResult res;
-    res.Count = length;
+    res.Count = std::min(data.size(), count);
+    std::copy_n(data.begin(), res.Count, buffer);
 
-    LOG(Debug) << "read " << length << " bytes: " << WBMQTT::HexDump(buffer, length);
+    LOG(Debug) << "read " << res.Count << " bytes: " << WBMQTT::HexDump(buffer, res.Count);
     return res;
 }
 
 void TWASMPort::SkipNoise()
-{}
+{
+    Flush();
+}
 
 void TWASMPort::SleepSinceLastInteraction(const std::chrono::microseconds& us)
 {}
 
 std::chrono::microseconds TWASMPort::GetSendTimeBytes(double bytesNumber) const
 {
-    return std::chrono::microseconds(0);
+    // start bit, data bits, parity bit and stop bits
+    auto bitsPerByte = 1 + Settings.DataBits + (Settings.Parity == 'N' ? 0 : 1) + Settings.StopBits;
+    auto us = std::ceil(bytesNumber * bitsPerByte * 1000000 / Settings.BaudRate);
+    return std::chrono::microseconds(static_cast<int64_t>(us));
 }
 
 std::chrono::microseconds TWASMPort::GetSendTimeBits(size_t bitsNumber) const
 {
-    return std::chrono::microseconds(0);
+    return std::chrono::microseconds((bitsNumber * 1000000 + Settings.BaudRate - 1) / Settings.BaudRate);
 }
 
 std::string TWASMPort::GetDescription(bool verbose) const
@@ -107,14 +312,516 @@ std::string TWASMPort::GetDescription(bool verbose) const
 
 void TWASMPort::ApplySerialPortSettings(const TSerialPortConnectionSettings& settings)
 {
-    // clang-format off
-    EM_ASM(
-    {
-        Module.serial.setOptions($0, $1, $2, $3);
-    },
-    settings.BaudRate, settings.DataBits, settings.Parity, settings.StopBits);
-    // clang-format on
+    Flush();
+    Settings = settings;
+    BusSetOptions(settings);
+
+    if (IsTracing()) {
+        TraceWriter->AddSettings(settings.BaudRate, settings.DataBits, settings.Parity, settings.StopBits);
+    }
 
     LOG(Debug) << "set options: " << settings.BaudRate << " " << settings.DataBits << "-" << settings.Parity << "-"
                << settings.StopBits;
 }
+
+std::vector<uint8_t> TWASMPort::Listen(const std::chrono::milliseconds& duration)
+{
+    Flush();
+    auto start = std::chrono::steady_clock::now();
+    auto data = BusListen(static_cast<int>(duration.count()));
+    CountCrossing(start);
+
+    if (IsTracing()) {
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        TraceWriter->AddListen(static_cast<int>(duration.count()), data, elapsed);
+    }
+
+    LOG(Debug) << "received " << data.size() << " bytes in " << duration.count() << " ms";
+    return data;
+}
+
+std::vector<uint8_t> TWASMPort::ReadReply(size_t count,
+                                          const std::chrono::microseconds& timeout,
+                                          const std::chrono::microseconds& frameTimeout)
+{
+    auto data = Receive(count, ToMilliseconds(timeout), ToMilliseconds(frameTimeout));
+
+    if (!data.empty()) {
+        LOG(Debug) << "read " << data.size() << " bytes: " << WBMQTT::HexDump(data.data(), data.size());
+    }
+
+    return data;
+}
+
+std::vector<uint8_t> TWASMPort::TransactPdu(uint8_t slaveId, const std::vector<uint8_t>& pdu, size_t replyPduSize)
+{
+    std::vector<uint8_t> frame{slaveId};
+    frame.insert(frame.end(), pdu.begin(), pdu.end());
+    ModbusRTU::AppendCRC(frame);
+
+    WriteBytes(frame.data(), frame.size());
+
+    // exception replies are shorter, they are completed by the frame gap
+    auto reply = ReadReply(replyPduSize + 3, std::chrono::microseconds::zero(), GetSendTimeBytes(3.5));
+
+    if (reply.size() < 4 || reply[0] != slaveId || !ModbusRTU::IsValidFrame(reply.data(), reply.size())) {
+        return std::vector<uint8_t>();
+    }
+
+    return std::vector<uint8_t>(reply.begin() + 1, reply.end() - 2);
+}
+
+void TWASMPort::SetTransactEnabled(bool enabled)
+{
+    Flush();
+    TransactEnabled = enabled;
+}
+
+uint8_t TWASMPort::GetSlaveId(const std::vector<uint8_t>& request) const
+{
+    return request[0];
+}
+
+TWASMPort::TStats TWASMPort::TakeStats()
+{
+    auto stats = Stats;
+    stats.IoTime = std::chrono::microseconds(static_cast<int64_t>(BusTakeIoTime() * 1000));
+    Stats = TStats();
+    return stats;
+}
+
+void TWASMPort::StartTrace()
+{
+    TraceWriter = std::make_unique<Trace::TWriter>();
+    TraceFull = false;
+    TraceWriter->AddSettings(Settings.BaudRate, Settings.DataBits, Settings.Parity, Settings.StopBits);
+}
+
+void TWASMPort::TraceRequest(const std::string& name, const std::string& data)
+{
+    if (IsTracing()) {
+        TraceWriter->AddRequest(name, data);
+    }
+}
+
+size_t TWASMPort::GetTraceSize() const
+{
+    return TraceWriter ? TraceWriter->GetData().size() : 0;
+}
+
+bool TWASMPort::IsTracing()
+{
+    if (!TraceWriter || TraceFull) {
+        return false;
+    }
+
+    if (TraceWriter->GetData().size() >= MAX_TRACE_SIZE) {
+        LOG(Warn) << "trace reached " << MAX_TRACE_SIZE << " bytes, recording is stopped";
+        TraceFull = true;
+        return false;
+    }
+
+    return true;
+}
+
+std::vector<uint8_t> TWASMPort::GetTrace() const
+{
+    return TraceWriter ? TraceWriter->GetData() : std::vector<uint8_t>();
+}
+
+void TWASMPort::StartReadSplitting(uint8_t slaveId, const TReadLimits& limits)
+{
+    ReadSplitting = true;
+    ReadSplittingSlaveId = slaveId;
+    ReadLimits = limits;
+}
+
+const TWASMPort::TReadLimits& TWASMPort::GetReadLimits() const
+{
+    return ReadLimits;
+}
+
+void TWASMPort::StopReadSplitting()
+{
+    ReadSplitting = false;
+}
+
+// Sends the written request and returns the reply. A read from the device with read splitting started skips excluded
+// registers and, if the device rejects it, is bisected, the reply of the whole read is made from the parts.
+std::vector<uint8_t> TWASMPort::ReadRegisters(size_t count)
+{
+    auto request = PendingWrite;
+
+    if (!ReadSplitting || request.size() != READ_REQUEST_SIZE || request[0] != ReadSplittingSlaveId ||
+        request[1] < 1 || request[1] > 4 || !ModbusRTU::IsValidFrame(request.data(), request.size()))
+    {
+        return Receive(count, 0, 0);
+    }
+
+    auto function = request[1];
+    uint16_t address = (request[2] << 8) | request[3];
+    uint16_t registersCount = (request[4] << 8) | request[5];
+    auto excluded = std::any_of(ReadLimits.Excluded.begin(), ReadLimits.Excluded.end(), [&](const auto& item) {
+        return item.first == function && item.second >= address && item.second < address + registersCount;
+    });
+
+    std::vector<uint8_t> reply;
+
+    if (!excluded) {
+        reply = Receive(count, 0, 0);
+
+        // anything but a rejection of several registers is passed as is
+        if (registersCount == 1 || reply.size() != 5 || reply[1] != (function | EXCEPTION_FLAG) ||
+            (reply[2] != ILLEGAL_DATA_ADDRESS && reply[2] != ILLEGAL_DATA_VALUE))
+        {
+            return reply;
+        }
+
+        LOG(Info) << "slave id " << static_cast<int>(ReadSplittingSlaveId) << " rejected read of " << registersCount
+                  << " registers from " << address << ", the read is split";
+    }
+
+    PendingWrite.clear();
+    std::vector<uint16_t> values(registersCount);
+
+    if (!ReadRange(function, address, registersCount, values.data())) {
+        return reply;
+    }
+
+    std::vector<uint8_t> frame{ReadSplittingSlaveId, function};
+
+    if (IsBitFunction(function)) {
+        frame.push_back((registersCount + 7) / 8);
+        frame.resize(frame.size() + frame.back());
+
+        for (size_t i = 0; i < values.size(); ++i) {
+            frame[3 + i / 8] |= (values[i] & 1) << (i % 8);
+        }
+    } else {
+        frame.push_back(registersCount * 2);
+
+        for (auto value: values) {
+            frame.push_back(value >> 8);
+            frame.push_back(value & 0xFF);
+        }
+    }
+
+    ModbusRTU::AppendCRC(frame);
+    return frame;
+}
+
+// Reads the range around excluded registers, a rejected range is bisected and a rejected single register is excluded.
+// Returns false if the device doesn't reply or replies with another error.
+bool TWASMPort::ReadRange(uint8_t function, uint16_t address, uint16_t count, uint16_t* values)
+{
+    for (uint16_t i = 0; i < count; ++i) {
+        if (ReadLimits.Excluded.count(std::make_pair(function, static_cast<uint16_t>(address + i)))) {
+            values[i] = 0;
+            return ReadRange(function, address, i, values) &&
+                   ReadRange(function, address + i + 1, count - i - 1, values + i + 1);
+        }
+    }
+
+    auto bits = IsBitFunction(function);
+    auto maxCount = bits ? 0 : ReadLimits.MaxReadRegisters;
+
+    if (!count) {
+        return true;
+    }
+
+    if (maxCount && count > maxCount) {
+        return ReadRange(function, address, maxCount, values) &&
+               ReadRange(function, address + maxCount, count - maxCount, values + maxCount);
+    }
+
+    auto reply = ReadValues(ReadSplittingSlaveId, function, address, count, values);
+
+    if (reply.size() == 2 && reply[0] == (function | EXCEPTION_FLAG) &&
+        (reply[1] == ILLEGAL_DATA_ADDRESS || reply[1] == ILLEGAL_DATA_VALUE))
+    {
+        if (count == 1) {
+            LOG(Warn) << "slave id " << static_cast<int>(ReadSplittingSlaveId) << " doesn't support register "
+                      << address << " of function " << static_cast<int>(function) << ", it isn't read anymore";
+            ReadLimits.Excluded.insert(std::make_pair(function, address));
+            values[0] = 0;
+            return true;
+        }
+
+        auto half = count / 2;
+        auto excludedCount = ReadLimits.Excluded.size();
+
+        if (!ReadRange(function, address, half, values) ||
+            !ReadRange(function, address + half, count - half, values + half))
+        {
+            return false;
+        }
+
+        // both halves are accepted as a whole, so the device limits the read size rather than rejects a register
+        uint16_t accepted = count - half;
+
+        if (reply[1] == ILLEGAL_DATA_VALUE && !bits && ReadLimits.Excluded.size() == excludedCount &&
+            (!ReadLimits.MaxReadRegisters || accepted < ReadLimits.MaxReadRegisters))
+        {
+            ReadLimits.MaxReadRegisters = accepted;
+        }
+
+        return true;
+    }
+
+    return !reply.empty() && reply[0] == function;
+}
+
+// Reads registers or bits of the function to values. Returns the reply PDU, which may be an exception reply, or empty
+// PDU if the device doesn't reply or the reply doesn't match the request.
+std::vector<uint8_t> TWASMPort::ReadValues(uint8_t slaveId,
+                                           uint8_t function,
+                                           uint16_t address,
+                                           uint16_t count,
+                                           uint16_t* values)
+{
+    auto bits = IsBitFunction(function);
+    uint16_t size = bits ? (count + 7) / 8 : count * 2;
+    auto reply = TWASMPort::TransactPdu(slaveId,
+                                        {function,
+                                         static_cast<uint8_t>(address >> 8),
+                                         static_cast<uint8_t>(address & 0xFF),
+                                         static_cast<uint8_t>(count >> 8),
+                                         static_cast<uint8_t>(count & 0xFF)},
+                                        size + 2);
+
+    if (reply.size() == 2 && reply[0] == (function | EXCEPTION_FLAG)) {
+        return reply;
+    }
+
+    if (reply.size() != size + 2u || reply[0] != function || reply[1] != size) {
+        return std::vector<uint8_t>();
+    }
+
+    for (uint16_t i = 0; i < count; ++i) {
+        values[i] = bits ? (reply[2 + i / 8] >> (i % 8)) & 1 : (reply[2 + i * 2] << 8) | reply[3 + i * 2];
+    }
+
+    return reply;
+}
+
+void TWASMPort::StartWriteCoalescing(uint8_t slaveId, const TReadLimits& limits, bool skipUnchanged)
+{
+    WriteCoalescing = true;
+    WriteCoalescingSlaveId = slaveId;
+    WriteLimits = limits;
+    SkipUnchangedWrites = skipUnchanged;
+    CollectedWrites.clear();
+}
+
+void TWASMPort::FinishWriteCoalescing()
+{
+    WriteCoalescing = false;
+    SendWrites();
+}
+
+void TWASMPort::StopWriteCoalescing()
+{
+    WriteCoalescing = false;
+    CollectedWrites.clear();
+}
+
+// Collects the written request if it's a write to the device with write coalescing started and returns the reply the
+// device sends to it. Returns empty data for other requests.
+std::vector<uint8_t> TWASMPort::CollectWrite()
+{
+    const auto& request = PendingWrite;
+
+    if (!WriteCoalescing || request.size() < READ_REQUEST_SIZE || request[0] != WriteCoalescingSlaveId ||
+        !ModbusRTU::IsValidFrame(request.data(), request.size()))
+    {
+        return std::vector<uint8_t>();
+    }
+
+    auto function = request[1];
+    uint16_t address = (request[2] << 8) | request[3];
+    uint16_t value = (request[4] << 8) | request[5];
+    std::vector<uint8_t> reply;
+
+    if ((function == WRITE_REGISTER || function == WRITE_COIL) && request.size() == READ_REQUEST_SIZE) {
+        if (function == WRITE_REGISTER) {
+            CollectedWrites.push_back({READ_HOLDING, address, value});
+        } else {
+            CollectedWrites.push_back({READ_COILS, address, value == COIL_ON});
+        }
+
+        // single writes are confirmed by an echo
+        reply = request;
+    } else if (function == WRITE_REGISTERS || function == WRITE_COILS) {
+        // the value is the count of written registers followed by the data size and the data
+        auto bits = function == WRITE_COILS;
+        size_t size = bits ? (value + 7) / 8 : value * 2;
+
+        if (!value || request[6] != size || request.size() != READ_REQUEST_SIZE + 1 + size) {
+            return std::vector<uint8_t>();
+        }
+
+        for (uint16_t i = 0; i < value; ++i) {
+            CollectedWrites.push_back(
+                {bits ? READ_COILS : READ_HOLDING,
+                 static_cast<uint16_t>(address + i),
+                 static_cast<uint16_t>(bits ? (request[7 + i / 8] >> (i % 8)) & 1
+                                            : (request[7 + i * 2] << 8) | request[8 + i * 2])});
+        }
+
+        reply.assign(request.begin(), request.begin() + 6);
+        ModbusRTU::AppendCRC(reply);
+    } else {
+        return std::vector<uint8_t>();
+    }
+
+    LOG(Debug) << "write of function " << static_cast<int>(function) << " to " << address << " is collected";
+    PendingWrite.clear();
+    return reply;
+}
+
+// Sends collected writes in the order they were made. Only consecutive writes to adjacent registers of one function
+// are joined to a block, so the device gets the writes in the same order as from wb-mqtt-serial.
+void TWASMPort::SendWrites()
+{
+    auto writes = std::move(CollectedWrites);
+    CollectedWrites.clear();
+
+    for (auto it = writes.begin(); it != writes.end();) {
+        auto function = it->Function;
+        auto address = it->Address;
+        size_t maxCount = IsBitFunction(function) ? MAX_WRITE_COILS : MAX_WRITE_REGISTERS;
+
+        if (!IsBitFunction(function) && WriteLimits.MaxReadRegisters) {
+            maxCount = std::min<size_t>(maxCount, WriteLimits.MaxReadRegisters);
+        }
+
+        std::vector<uint16_t> values;
+
+        while (it != writes.end() && it->Function == function && it->Address == address + values.size() &&
+               values.size() < maxCount)
+        {
+            values.push_back(it->Value);
+            ++it;
+        }
+
+        SendWriteBlock(function, address, values);
+    }
+}
+
+// Writes the block as is unless unchanged registers are skipped. Then the block is read and registers which don't
+// hold the values yet are written, adjacent ones in one request, and written registers are read back in one
+// request. A block which the device doesn't read is written as a whole and isn't verified, it may contain write only
+// registers.
+void TWASMPort::SendWriteBlock(uint8_t function, uint16_t address, const std::vector<uint16_t>& values)
+{
+    uint16_t count = values.size();
+
+    if (!SkipUnchangedWrites) {
+        WriteValues(function, address, values.data(), count);
+        return;
+    }
+
+    std::vector<uint16_t> current(count);
+    auto excluded = std::any_of(WriteLimits.Excluded.begin(), WriteLimits.Excluded.end(), [&](const auto& item) {
+        return item.first == function && item.second >= address && item.second < address + count;
+    });
+    auto readable = false;
+
+    if (!excluded) {
+        auto reply = ReadValues(WriteCoalescingSlaveId, function, address, count, current.data());
+        readable = !reply.empty() && reply[0] == function;
+    }
+
+    uint16_t first = count;
+    uint16_t last = 0;
+
+    for (uint16_t i = 0; i < count;) {
+        if (readable && current[i] == values[i]) {
+            ++i;
+            continue;
+        }
+
+        auto end = i;
+
+        while (end < count && !(readable && current[end] == values[end])) {
+            ++end;
+        }
+
+        WriteValues(function, address + i, values.data() + i, end - i);
+        first = std::min(first, i);
+        last = end;
+        i = end;
+    }
+
+    if (first == count) {
+        LOG(Debug) << "registers from " << address << " already hold written values";
+        return;
+    }
+
+    if (!readable) {
+        return;
+    }
+
+    // a device may reply at other line settings after the write, such writes are confirmed by their replies only
+    auto reply = ReadValues(WriteCoalescingSlaveId, function, address + first, last - first, current.data() + first);
+
+    if (reply.empty() || reply[0] != function) {
+        LOG(Warn) << "slave id " << static_cast<int>(WriteCoalescingSlaveId) << " didn't read back registers from "
+                  << address + first;
+        return;
+    }
+
+    for (auto i = first; i < last; ++i) {
+        if (current[i] != values[i]) {
+            throw TSerialDeviceException("slave id " + std::to_string(WriteCoalescingSlaveId) + " didn't keep value " +
+                                         std::to_string(values[i]) + " written to register " +
+                                         std::to_string(address + i));
+        }
+    }
+}
+
+// Writes registers or coils with a single write if there is one value and with a multiple write otherwise
+void TWASMPort::WriteValues(uint8_t function, uint16_t address, const uint16_t* values, uint16_t count)
+{
+    auto bits = IsBitFunction(function);
+    std::vector<uint8_t> pdu{0, static_cast<uint8_t>(address >> 8), static_cast<uint8_t>(address & 0xFF)};
+
+    if (count == 1) {
+        pdu[0] = bits ? WRITE_COIL : WRITE_REGISTER;
+        uint16_t value = bits ? (values[0] ? COIL_ON : 0) : values[0];
+        pdu.push_back(value >> 8);
+        pdu.push_back(value & 0xFF);
+    } else {
+        pdu[0] = bits ? WRITE_COILS : WRITE_REGISTERS;
+        pdu.push_back(count >> 8);
+        pdu.push_back(count & 0xFF);
+        pdu.push_back(bits ? (count + 7) / 8 : count * 2);
+        pdu.resize(pdu.size() + pdu.back());
+
+        for (uint16_t i = 0; i < count; ++i) {
+            if (bits) {
+                pdu[6 + i / 8] |= (values[i] & 1) << (i % 8);
+            } else {
+                pdu[6 + i * 2] = values[i] >> 8;
+                pdu[7 + i * 2] = values[i] & 0xFF;
+            }
+        }
+    }
+
+    LOG(Debug) << "slave id " << static_cast<int>(WriteCoalescingSlaveId) << ": write " << count << " values of "
+               << "function " << static_cast<int>(function) << " from " << address;
+
+    // both single and multiple writes are confirmed by function, address and a value or a count
+    auto reply = TWASMPort::TransactPdu(WriteCoalescingSlaveId, pdu, 5);
+
+    if (reply.empty()) {
+        throw TResponseTimeoutException();
+    }
+
+    if (reply[0] != pdu[0]) {
+        auto code = reply.size() == 2 ? reply[1] : 0;
+        throw TSerialDeviceException("slave id " + std::to_string(WriteCoalescingSlaveId) + " rejected write of " +
+                                     std::to_string(count) + " registers from " + std::to_string(address) +
+                                     ", exception code " + std::to_string(code));
+    }
+}
@@ -1,8 +1,37 @@
+#pragma once
+
 #include "port/port.h"
+#include "wasm_response_timeouts.h"
+#include "wasm_trace.h"
+
+#include <memory>
+#include <set>
+#include <vector>
 
 class TWASMPort: public TPort
 {
 public:
+    // counters of JS calls suspending the C++ stack, used to measure the Asyncify overhead
+    struct TStats
+    {
+        size_t Transactions = 0;
+        size_t Crossings = 0;
+
+        // time of the calls measured in C++ and time of the serial operations measured in JS
+        std::chrono::microseconds CrossingTime = std::chrono::microseconds::zero();
+        std::chrono::microseconds IoTime = std::chrono::microseconds::zero();
+    };
+
+    // what a device accepts in reads learned by bisection of rejected ones
+    struct TReadLimits
+    {
+        // function code and address of registers which the device rejects even when they are read alone
+        std::set<std::pair<uint8_t, uint16_t>> Excluded;
+
+        // largest count of registers in one read, zero if the device accepts any
+        uint16_t MaxReadRegisters = 0;
+    };
+
     TWASMPort();
 
     void Open() override;
@@ -24,4 +53,151 @@ public:
     std::chrono::microseconds GetSendTimeBits(size_t bitsNumber) const override;
     std::string GetDescription(bool verbose) const override;
     void ApplySerialPortSettings(const TSerialPortConnectionSettings& settings) override;
+
+    /**
+     * @brief Receives everything sent on the bus during the time without sending anything
+     */
+    std::vector<uint8_t> Listen(const std::chrono::milliseconds& duration);
+
+    /**
+     * @brief Reads a reply of up to count bytes, the reply ends when the line stays idle for the frame timeout
+     * after some data is received. Returns empty data if nothing is received in the timeout.
+     */
+    std::vector<uint8_t> ReadReply(size_t count,
+                                   const std::chrono::microseconds& timeout,
+                                   const std::chrono::microseconds& frameTimeout);
+
+    /**
+     * @brief Sends a Modbus request PDU to the device and returns the reply PDU, which may be an exception reply.
+     * Returns empty PDU if the device doesn't reply or the reply is damaged. Response timeout is adaptive.
+     */
+    virtual std::vector<uint8_t> TransactPdu(uint8_t slaveId, const std::vector<uint8_t>& pdu, size_t replyPduSize);
+
+    /**
+     * @brief Sends a written request which isn't followed by a read
+     */
+    void Flush();
+
+    /**
+     * @brief Enables sending of a request together with reading of its reply in one JS call
+     */
+    void SetTransactEnabled(bool enabled);
+
+    /**
+     * @brief Returns counters collected since the previous call and resets them
+     */
+    TStats TakeStats();
+
+    /**
+     * @brief Starts recording of all port operations and RPC requests to a trace, a previous trace is dropped
+     */
+    void StartTrace();
+
+    /**
+     * @brief Adds an RPC request to the trace if it's recorded, so the session can be replayed
+     */
+    void TraceRequest(const std::string& name, const std::string& data);
+
+    /**
+     * @brief Returns the trace recorded since StartTrace, empty data if the trace isn't recorded
+     */
+    std::vector<uint8_t> GetTrace() const;
+
+    size_t GetTraceSize() const;
+
+    /**
+     * @brief Starts splitting of reads from the slave id. Excluded registers aren't read and get zero values, a read
+     * rejected by the device is bisected to find the registers it doesn't support, other blocks are read as is.
+     */
+    void StartReadSplitting(uint8_t slaveId, const TReadLimits& limits);
+
+    /**
+     * @brief Returns limits of the device learned since StartReadSplitting
+     */
+    const TReadLimits& GetReadLimits() const;
+
+    void StopReadSplitting();
+
+    /**
+     * @brief Starts collecting of register and coil writes to the slave id. The writes are answered at once and are
+     * sent by FinishWriteCoalescing, any other request sends them first. Blocks of adjacent registers aren't larger
+     * than the device reads. Registers which already hold the values are skipped only with skipUnchanged, it's
+     * for settings, a write to a command register acts even if the register holds the value.
+     */
+    void StartWriteCoalescing(uint8_t slaveId, const TReadLimits& limits, bool skipUnchanged = false);
+
+    /**
+     * @brief Sends the collected writes in the order they were made, consecutive writes to adjacent registers in one
+     * request. With skipUnchanged registers are read first, only changed ones are written and then read back once
+     * per block. Throws if the device rejects a write or doesn't keep a written value.
+     */
+    void FinishWriteCoalescing();
+
+    /**
+     * @brief Drops the collected writes without sending them
+     */
+    void StopWriteCoalescing();
+
+protected:
+    /**
+     * @brief Returns slave id of a request, used to keep response time estimates per device
+     */
+    virtual uint8_t GetSlaveId(const std::vector<uint8_t>& request) const;
+
+    // Operations of the bus implemented by Module.serial, a replay port takes results from a trace instead.
+    // Timeouts and frame gaps are in milliseconds, a zero timeout is the default timeout of Module.serial.
+    virtual void BusSetOptions(const TSerialPortConnectionSettings& settings);
+    virtual void BusWrite(const std::vector<uint8_t>& data);
+    virtual std::vector<uint8_t> BusExchange(const std::vector<uint8_t>& request,
+                                             size_t count,
+                                             int timeout,
+                                             int frameGap);
+    virtual std::vector<uint8_t> BusListen(int duration);
+
+    /**
+     * @brief Returns time of the bus operations in milliseconds since the previous call
+     */
+    virtual double BusTakeIoTime();
+
+private:
+    TSerialPortConnectionSettings Settings;
+    std::vector<uint8_t> PendingWrite;
+    bool TransactEnabled = true;
+    TStats Stats;
+    TResponseTimeouts ResponseTimeouts;
+    std::unique_ptr<Trace::TWriter> TraceWriter;
+    bool TraceFull = false;
+    bool ReadSplitting = false;
+    uint8_t ReadSplittingSlaveId = 0;
+    TReadLimits ReadLimits;
+    bool WriteCoalescing = false;
+    uint8_t WriteCoalescingSlaveId = 0;
+    TReadLimits WriteLimits;
+    bool SkipUnchangedWrites = false;
+
+    // collected write of one register or coil, coils are stored as registers of read function 1
+    struct TCollectedWrite
+    {
+        uint8_t Function;
+        uint16_t Address;
+        uint16_t Value;
+    };
+
+    // writes in the order of the requests of wb-mqtt-serial
+    std::vector<TCollectedWrite> CollectedWrites;
+
+    std::vector<uint8_t> Receive(size_t count, int timeout, int frameGap);
+    void CountCrossing(const std::chrono::steady_clock::time_point& start);
+    bool IsTracing();
+    std::vector<uint8_t> ReadRegisters(size_t count);
+    bool ReadRange(uint8_t function, uint16_t address, uint16_t count, uint16_t* values);
+    std::vector<uint8_t> ReadValues(uint8_t slaveId,
+                                    uint8_t function,
+                                    uint16_t address,
+                                    uint16_t count,
+                                    uint16_t* values);
+    std::vector<uint8_t> CollectWrite();
+    void SendWrites();
+    void SendWriteBlock(uint8_t function, uint16_t address, const std::vector<uint16_t>& values);
+    void WriteValues(uint8_t function, uint16_t address, const uint16_t* values, uint16_t count);
 };
@@ -0,0 +1,79 @@
+#include "wasm_precomputed.h"
+
+#include <cctype>
+#include <stdexcept>
+#include <vector>
+#include <zlib.h>
+
+namespace
+{
+    const auto CHUNK_SIZE = 64 * 1024;
+
+    // device types may contain spaces, slashes and non-ASCII characters, so they are escaped to get a file name
+    std::string EscapeFileName(const std::string& name)
+    {
+        const auto hex = "0123456789abcdef";
+        std::string res;
+
+        for (unsigned char c: name) {
+            if (isalnum(c) || c == '-' || c == '_' || c == '.') {
+                res += c;
+                continue;
+            }
+
+            res += '%';
+            res += hex[c >> 4];
+            res += hex[c & 0x0F];
+        }
+
+        return res;
+    }
+}
+
+std::string Precomputed::GetDeviceTypesPath(const std::string& lang)
+{
+    return std::string(DIR) + "/device-types-" + EscapeFileName(lang) + ".json.gz";
+}
+
+std::string Precomputed::GetSchemaPath(const std::string& deviceType)
+{
+    return std::string(DIR) + "/schema-" + EscapeFileName(deviceType) + ".json.gz";
+}
+
+bool Precomputed::Read(const std::string& path, std::string& data)
+{
+    auto file = gzopen(path.c_str(), "rb");
+
+    if (!file) {
+        return false;
+    }
+
+    // the wasm stack is small, so the buffer isn't put there
+    std::vector<char> buffer(CHUNK_SIZE);
+    int count;
+
+    data.clear();
+
+    while ((count = gzread(file, buffer.data(), buffer.size())) > 0) {
+        data.append(buffer.data(), count);
+    }
+
+    gzclose(file);
+    return count == 0;
+}
+
+void Precomputed::Write(const std::string& path, const std::string& data)
+{
+    auto file = gzopen(path.c_str(), "wb9");
+
+    if (!file) {
+        throw std::runtime_error("Failed to create " + path);
+    }
+
+    auto count = gzwrite(file, data.data(), data.size());
+    gzclose(file);
+
+    if (count != static_cast<int>(data.size())) {
+        throw std::runtime_error("Failed to write " + path);
+    }
+}
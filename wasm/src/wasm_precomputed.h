@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string>
+
+// Schemas and device type lists generated at build time by wasm/tools/schemas_generator.cpp
+namespace Precomputed
+{
+    const auto DIR = "precomputed";
+
+    std::string GetDeviceTypesPath(const std::string& lang);
+    // schemas hold translations for all languages, so they are the same for any language of the page
+    std::string GetSchemaPath(const std::string& deviceType);
+
+    /**
+     * @brief Reads and decompresses precomputed file, returns false if the file doesn't exist
+     */
+    bool Read(const std::string& path, std::string& data);
+
+    /**
+     * @brief Writes compressed file. Throws std::runtime_error on failure
+     */
+    void Write(const std::string& path, const std::string& data);
+}
@@ -0,0 +1,132 @@
+#include "wasm_replay_port.h"
+#include "log.h"
+
+#include <algorithm>
+
+#include <emscripten/emscripten.h>
+
+#define LOG(logger) logger.Log() << "[wasm replay] "
+
+TReplayPort::TReplayPort(std::vector<uint8_t> trace, double speed): Speed(speed)
+{
+    Trace::TReader reader(std::move(trace));
+    Trace::TRecord record;
+
+    while (reader.Next(record)) {
+        switch (record.Type) {
+            case Trace::TRecordType::Request:
+                Requests.push_back(record);
+                break;
+
+            // line settings are recorded for diagnostics, the replayed requests apply them again
+            case Trace::TRecordType::Settings:
+                break;
+
+            default:
+                Operations.push_back(record);
+                break;
+        }
+    }
+
+    LOG(Info) << "trace with " << Requests.size() << " requests and " << Operations.size() << " operations";
+}
+
+const std::vector<Trace::TRecord>& TReplayPort::GetRequests() const
+{
+    return Requests;
+}
+
+TReplayPort::TReplayStats TReplayPort::GetReplayStats() const
+{
+    return ReplayStats;
+}
+
+void TReplayPort::BusSetOptions(const TSerialPortConnectionSettings& settings)
+{}
+
+void TReplayPort::BusWrite(const std::vector<uint8_t>& data)
+{
+    if (Next < Operations.size() && Operations[Next].Type == Trace::TRecordType::Exchange &&
+        Operations[Next].Request == data)
+    {
+        UnsentRequest = data;
+    } else {
+        Take(Trace::TRecordType::Write, data);
+    }
+
+    Wait(std::chrono::microseconds::zero());
+}
+
+std::vector<uint8_t> TReplayPort::BusExchange(const std::vector<uint8_t>& request,
+                                              size_t count,
+                                              int timeout,
+                                              int frameGap)
+{
+    auto record = Take(Trace::TRecordType::Exchange, request.empty() ? UnsentRequest : request);
+    UnsentRequest.clear();
+
+    if (!record) {
+        return std::vector<uint8_t>();
+    }
+
+    Wait(record->Duration);
+    return std::vector<uint8_t>(record->Reply.begin(), record->Reply.begin() + std::min(count, record->Reply.size()));
+}
+
+std::vector<uint8_t> TReplayPort::BusListen(int duration)
+{
+    auto record = Take(Trace::TRecordType::Listen, std::vector<uint8_t>());
+
+    if (!record) {
+        return std::vector<uint8_t>();
+    }
+
+    Wait(record->Duration);
+    return record->Reply;
+}
+
+double TReplayPort::BusTakeIoTime()
+{
+    auto time = IoTime;
+    IoTime = 0;
+    return time;
+}
+
+// Returns the next recorded operation if it's of the same type, a request differing from the recorded one is
+// counted as a mismatch but still gets the recorded reply
+const Trace::TRecord* TReplayPort::Take(Trace::TRecordType type, const std::vector<uint8_t>& request)
+{
+    ++ReplayStats.Operations;
+
+    if (Next >= Operations.size()) {
+        ++ReplayStats.Missing;
+        return nullptr;
+    }
+
+    const auto& record = Operations[Next++];
+
+    if (record.Type != type || record.Request != request) {
+        ++ReplayStats.Mismatches;
+        LOG(Warn) << "operation " << Next - 1 << " differs from the trace";
+    }
+
+    return record.Type == type ? &record : nullptr;
+}
+
+// Suspends the stack for the recorded duration divided by the speed, an operation without waiting still suspends it
+void TReplayPort::Wait(const std::chrono::microseconds& duration)
+{
+    auto milliseconds = Speed > 0 ? static_cast<int>(duration.count() / 1000 / Speed) : 0;
+    IoTime += milliseconds;
+
+    // clang-format off
+    EM_ASM(
+    {
+        Asyncify.handleAsync(async() => {
+            if ($0)
+                await new Promise((resolve) => setTimeout(resolve, $0));
+        });
+    },
+    milliseconds);
+    // clang-format on
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "wasm_port.h"
+
+// Port feeding a trace recorded by TWASMPort back to the module instead of using the bus. Bus operations take
+// results of the recorded ones in order, so the same RPC requests go through the same code paths as in the recorded
+// session. Written data which differs from the recording is counted to show that the replay went another way.
+// Every operation suspends the C++ stack like operations of the real port, so the replay measures the Asyncify
+// overhead, and a trace recorded with transact enabled can be replayed with it disabled to compare them.
+class TReplayPort: public TWASMPort
+{
+public:
+    struct TReplayStats
+    {
+        size_t Operations = 0;
+        size_t Mismatches = 0;
+
+        // operations after the end of the trace, they get no reply
+        size_t Missing = 0;
+    };
+
+    /**
+     * @brief Replays the trace with recorded durations of operations divided by the speed, zero speed replays
+     * without waiting. Throws std::runtime_error if the trace is damaged.
+     */
+    TReplayPort(std::vector<uint8_t> trace, double speed);
+
+    /**
+     * @brief Returns RPC requests recorded in the trace
+     */
+    const std::vector<Trace::TRecord>& GetRequests() const;
+
+    TReplayStats GetReplayStats() const;
+
+protected:
+    void BusSetOptions(const TSerialPortConnectionSettings& settings) override;
+    void BusWrite(const std::vector<uint8_t>& data) override;
+    std::vector<uint8_t> BusExchange(const std::vector<uint8_t>& request,
+                                     size_t count,
+                                     int timeout,
+                                     int frameGap) override;
+    std::vector<uint8_t> BusListen(int duration) override;
+    double BusTakeIoTime() override;
+
+private:
+    std::vector<Trace::TRecord> Operations;
+    std::vector<Trace::TRecord> Requests;
+    size_t Next = 0;
+    double Speed;
+    double IoTime = 0;
+    TReplayStats ReplayStats;
+
+    // request written separately which is recorded together with reading of its reply
+    std::vector<uint8_t> UnsentRequest;
+
+    const Trace::TRecord* Take(Trace::TRecordType type, const std::vector<uint8_t>& request);
+    void Wait(const std::chrono::microseconds& duration);
+};
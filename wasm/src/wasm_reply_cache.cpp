@@ -0,0 +1,63 @@
+#include "wasm_reply_cache.h"
+
+TReplyCache::TReplyCache(size_t maxSize): MaxSize(maxSize)
+{}
+
+const std::string* TReplyCache::Find(const std::string& key)
+{
+    auto it = Index.find(key);
+
+    if (it == Index.end()) {
+        return nullptr;
+    }
+
+    Entries.splice(Entries.begin(), Entries, it->second);
+    return &it->second->second;
+}
+
+void TReplyCache::Insert(const std::string& key, const std::string& reply)
+{
+    auto it = Index.find(key);
+
+    if (it != Index.end()) {
+        Size -= it->second->first.size() + it->second->second.size();
+        Entries.erase(it->second);
+        Index.erase(it);
+    }
+
+    if (key.size() + reply.size() > MaxSize) {
+        return;
+    }
+
+    Entries.emplace_front(key, reply);
+    Index[key] = Entries.begin();
+    Size += key.size() + reply.size();
+    Shrink();
+}
+
+void TReplyCache::SetMaxSize(size_t maxSize)
+{
+    MaxSize = maxSize;
+    Shrink();
+}
+
+void TReplyCache::Clear()
+{
+    Entries.clear();
+    Index.clear();
+    Size = 0;
+}
+
+size_t TReplyCache::GetSize() const
+{
+    return Size;
+}
+
+void TReplyCache::Shrink()
+{
+    while (Size > MaxSize && !Entries.empty()) {
+        Size -= Entries.back().first.size() + Entries.back().second.size();
+        Index.erase(Entries.back().first);
+        Entries.pop_back();
+    }
+}
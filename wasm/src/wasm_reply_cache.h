@@ -0,0 +1,29 @@
+#pragma once
+
+#include <list>
+#include <string>
+#include <unordered_map>
+
+// LRU cache of serialized RPC replies limited by the total size of stored replies
+class TReplyCache
+{
+public:
+    explicit TReplyCache(size_t maxSize);
+
+    const std::string* Find(const std::string& key);
+    void Insert(const std::string& key, const std::string& reply);
+    void SetMaxSize(size_t maxSize);
+    void Clear();
+
+    size_t GetSize() const;
+
+private:
+    using TEntry = std::pair<std::string, std::string>;
+
+    void Shrink();
+
+    size_t MaxSize;
+    size_t Size = 0;
+    std::list<TEntry> Entries;
+    std::unordered_map<std::string, std::list<TEntry>::iterator> Index;
+};
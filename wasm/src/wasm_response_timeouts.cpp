@@ -0,0 +1,95 @@
+#include "wasm_response_timeouts.h"
+
+#include <algorithm>
+
+using namespace std::chrono;
+
+namespace
+{
+    // clock granularity, JS timers have millisecond resolution
+    const auto GRANULARITY = 1ms;
+
+    // timeout is doubled on every timeout of a device which replied before, but not more than this
+    const auto MAX_BACKOFF = 3;
+
+    const uint8_t BROADCAST_SLAVE_ID = 0;
+
+    // fast scan and events requests of WB extension
+    const uint8_t WB_EXTENSION_SLAVE_ID = 0xFD;
+
+    bool IsBroadcast(uint8_t slaveId)
+    {
+        return slaveId == BROADCAST_SLAVE_ID || slaveId == WB_EXTENSION_SLAVE_ID;
+    }
+}
+
+void TResponseTimeouts::TEstimate::AddSample(const microseconds& rtt)
+{
+    if (!HasSamples) {
+        Srtt = rtt;
+        RttVar = rtt / 2;
+        HasSamples = true;
+    } else {
+        auto delta = Srtt > rtt ? Srtt - rtt : rtt - Srtt;
+        RttVar = (RttVar * 3 + delta) / 4;
+        Srtt = (Srtt * 7 + rtt) / 8;
+    }
+
+    Backoff = 0;
+}
+
+microseconds TResponseTimeouts::TEstimate::GetTimeout() const
+{
+    return (Srtt + std::max<microseconds>(GRANULARITY, RttVar * 4)) * (1 << Backoff);
+}
+
+TResponseTimeouts::TResponseTimeouts(const microseconds& minDelay, const microseconds& maxDelay)
+    : MinDelay(minDelay),
+      MaxDelay(maxDelay)
+{}
+
+void TResponseTimeouts::AddSample(uint8_t slaveId, const microseconds& delay)
+{
+    if (IsBroadcast(slaveId)) {
+        return;
+    }
+
+    Slaves[slaveId].AddSample(delay);
+    Bus.AddSample(delay);
+}
+
+void TResponseTimeouts::AddTimeout(uint8_t slaveId)
+{
+    if (IsBroadcast(slaveId)) {
+        return;
+    }
+
+    // A device which replied before backs off a few times, so a lost reply doesn't slow down its polling for long.
+    // A device without replies backs off from the bus estimate until it gets the largest delay, so a device slower
+    // than the others on the bus gets time to reply and be sampled.
+    auto& estimate = Slaves[slaveId];
+
+    if ((!estimate.HasSamples || estimate.Backoff < MAX_BACKOFF) && GetDelay(slaveId) < MaxDelay) {
+        ++estimate.Backoff;
+    }
+}
+
+microseconds TResponseTimeouts::GetDelay(uint8_t slaveId) const
+{
+    if (IsBroadcast(slaveId)) {
+        return microseconds::zero();
+    }
+
+    auto it = Slaves.find(slaveId);
+
+    if (it != Slaves.end() && it->second.HasSamples) {
+        return std::clamp(it->second.GetTimeout(), MinDelay, MaxDelay);
+    }
+
+    if (!Bus.HasSamples) {
+        return microseconds::zero();
+    }
+
+    auto backoff = it != Slaves.end() ? it->second.Backoff : 0;
+    return std::clamp(Bus.GetTimeout() * (1 << backoff), MinDelay, MaxDelay);
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+
+// Adaptive response timeouts estimated per slave id like TCP retransmission timeouts (RFC 6298).
+// Estimates hold the device reply delay without the transfer time of frames, so they don't depend on the baud
+// rate and the frame size. Broadcast requests of Modbus and of WB extension are answered after arbitration or not at
+// all, so they always get the default timeout and aren't sampled.
+class TResponseTimeouts
+{
+public:
+    TResponseTimeouts(const std::chrono::microseconds& minDelay, const std::chrono::microseconds& maxDelay);
+
+    void AddSample(uint8_t slaveId, const std::chrono::microseconds& delay);
+    void AddTimeout(uint8_t slaveId);
+
+    /**
+     * @brief Returns time to wait for a reply after the frames are transferred. Slave ids without replies get
+     * the estimate of the whole bus doubled on each of their timeouts up to the largest delay. Returns zero for the
+     * default timeout, which is used until any device on the bus replies.
+     */
+    std::chrono::microseconds GetDelay(uint8_t slaveId) const;
+
+private:
+    struct TEstimate
+    {
+        std::chrono::microseconds Srtt = std::chrono::microseconds::zero();
+        std::chrono::microseconds RttVar = std::chrono::microseconds::zero();
+        int Backoff = 0;
+        bool HasSamples = false;
+
+        void AddSample(const std::chrono::microseconds& rtt);
+        std::chrono::microseconds GetTimeout() const;
+    };
+
+    std::chrono::microseconds MinDelay;
+    std::chrono::microseconds MaxDelay;
+    TEstimate Bus;
+    std::map<uint8_t, TEstimate> Slaves;
+};
@@ -0,0 +1,54 @@
+#include "wasm_socket_port.h"
+#include "wasm_modbus.h"
+
+TWASMSocketPort::TWASMSocketPort(bool modbusTcp): ModbusTcp(modbusTcp)
+{}
+
+// frames are transferred by the gateway, its line time is a part of the measured reply delay
+std::chrono::microseconds TWASMSocketPort::GetSendTimeBytes(double bytesNumber) const
+{
+    return std::chrono::microseconds::zero();
+}
+
+std::chrono::microseconds TWASMSocketPort::GetSendTimeBits(size_t bitsNumber) const
+{
+    return std::chrono::microseconds::zero();
+}
+
+std::string TWASMSocketPort::GetDescription(bool verbose) const
+{
+    return ModbusTcp ? "WASM Modbus TCP socket port" : "WASM RTU over TCP socket port";
+}
+
+std::vector<uint8_t> TWASMSocketPort::TransactPdu(uint8_t slaveId,
+                                                 const std::vector<uint8_t>& pdu,
+                                                 size_t replyPduSize)
+{
+    if (!ModbusTcp) {
+        return TWASMPort::TransactPdu(slaveId, pdu, replyPduSize);
+    }
+
+    auto frame = ModbusTCP::MakeFrame(++TransactionId, slaveId, pdu);
+    WriteBytes(frame.data(), frame.size());
+
+    // MBAP header tells the reply size, so exception replies are completed by the frame gap
+    auto reply = ReadReply(ModbusTCP::HEADER_SIZE + replyPduSize,
+                           std::chrono::microseconds::zero(),
+                           std::chrono::milliseconds(1));
+    auto size = ModbusTCP::GetFrameSize(reply.data(), reply.size());
+
+    if (!size || size <= ModbusTCP::HEADER_SIZE || ModbusTCP::GetTransactionId(reply.data()) != TransactionId) {
+        return std::vector<uint8_t>();
+    }
+
+    return std::vector<uint8_t>(reply.begin() + ModbusTCP::HEADER_SIZE, reply.begin() + size);
+}
+
+uint8_t TWASMSocketPort::GetSlaveId(const std::vector<uint8_t>& request) const
+{
+    if (ModbusTcp) {
+        return request.size() < ModbusTCP::HEADER_SIZE ? 0 : request[ModbusTCP::HEADER_SIZE - 1];
+    }
+
+    return TWASMPort::GetSlaveId(request);
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "wasm_port.h"
+
+// Port tunneling frames over a WebSocket to an Ethernet to RS-485 gateway, Module.serial is a WebSocketPort then.
+// Frames are raw RTU frames or Modbus TCP frames with MBAP header, line settings are configured in the gateway.
+class TWASMSocketPort: public TWASMPort
+{
+public:
+    explicit TWASMSocketPort(bool modbusTcp);
+
+    std::chrono::microseconds GetSendTimeBytes(double bytesNumber) const override;
+    std::chrono::microseconds GetSendTimeBits(size_t bitsNumber) const override;
+    std::string GetDescription(bool verbose) const override;
+    std::vector<uint8_t> TransactPdu(uint8_t slaveId, const std::vector<uint8_t>& pdu, size_t replyPduSize) override;
+
+protected:
+    uint8_t GetSlaveId(const std::vector<uint8_t>& request) const override;
+
+private:
+    bool ModbusTcp;
+    uint16_t TransactionId = 0;
+};
@@ -0,0 +1,178 @@
+#include "wasm_templates_pack.h"
+
+#include <fstream>
+#include <stdexcept>
+#include <sys/stat.h>
+
+namespace
+{
+    const auto FORMAT = "wb-templates-pack";
+    const auto VERSION = 1;
+    const auto REFERENCE_KEY = "$pack";
+    const auto CHUNK_SIZE = 64 * 1024;
+}
+
+TTemplatesPackReader::TTemplatesPackReader(const std::string& path)
+{
+    File = gzopen(path.c_str(), "rb");
+
+    if (!File) {
+        throw std::runtime_error("Failed to open templates pack " + path);
+    }
+
+    Json::CharReaderBuilder builder;
+    Reader.reset(builder.newCharReader());
+
+    std::string line;
+    Json::Value header;
+
+    if (ReadLine(line)) {
+        header = ParseLine(line);
+    }
+
+    if (header["format"].asString() != FORMAT || header["version"].asInt() != VERSION) {
+        gzclose(File);
+        throw std::runtime_error("Unknown templates pack format " + path);
+    }
+
+    TemplatesCount = header["templates"].asUInt();
+}
+
+TTemplatesPackReader::~TTemplatesPackReader()
+{
+    gzclose(File);
+}
+
+bool TTemplatesPackReader::Next(std::string& name, Json::Value& value)
+{
+    std::string line;
+
+    while (ReadLine(line)) {
+        auto record = ParseLine(line);
+        Resolve(record["value"]);
+
+        if (record.isMember("node")) {
+            if (record["node"].asUInt() != Nodes.size()) {
+                throw std::runtime_error("Broken templates pack: unexpected node " + record["node"].asString());
+            }
+
+            Nodes.emplace_back();
+            Nodes.back().swap(record["value"]);
+            continue;
+        }
+
+        name = record["template"].asString();
+        value.swap(record["value"]);
+        return true;
+    }
+
+    Nodes.clear();
+    return false;
+}
+
+size_t TTemplatesPackReader::GetTemplatesCount() const
+{
+    return TemplatesCount;
+}
+
+bool TTemplatesPackReader::ReadLine(std::string& line)
+{
+    while (true) {
+        auto end = Buffer.find('\n', Position);
+
+        if (end != std::string::npos) {
+            line.assign(Buffer, Position, end - Position);
+            Position = end + 1;
+            return true;
+        }
+
+        if (Eof) {
+            return false;
+        }
+
+        Buffer.erase(0, Position);
+        Position = 0;
+
+        // decompressed straight into the buffer, a chunk on the stack would take a large part of the wasm stack
+        auto size = Buffer.size();
+        Buffer.resize(size + CHUNK_SIZE);
+        auto count = gzread(File, &Buffer[size], CHUNK_SIZE);
+
+        if (count < 0) {
+            throw std::runtime_error("Failed to decompress templates pack");
+        }
+
+        Eof = (count == 0);
+        Buffer.resize(size + count);
+    }
+}
+
+Json::Value TTemplatesPackReader::ParseLine(const std::string& line)
+{
+    Json::Value value;
+    Json::String errors;
+
+    if (!Reader->parse(line.data(), line.data() + line.size(), &value, &errors)) {
+        throw std::runtime_error("Broken templates pack: " + errors);
+    }
+
+    return value;
+}
+
+void TTemplatesPackReader::Resolve(Json::Value& value) const
+{
+    if (value.isObject() && value.size() == 1 && value.isMember(REFERENCE_KEY)) {
+        auto id = value[REFERENCE_KEY].asUInt();
+
+        if (id >= Nodes.size()) {
+            throw std::runtime_error("Broken templates pack: unknown node " + std::to_string(id));
+        }
+
+        value = Nodes[id];
+        return;
+    }
+
+    if (value.isObject() || value.isArray()) {
+        for (auto& child: value) {
+            Resolve(child);
+        }
+    }
+}
+
+TTemplatesUnpacker::TTemplatesUnpacker(const std::string& packPath, const std::string& dir)
+    : Reader(packPath),
+      Dir(dir),
+      Writer(Json::StreamWriterBuilder().newStreamWriter())
+{
+    mkdir(Dir.c_str(), 0755);
+}
+
+bool TTemplatesUnpacker::UnpackNext()
+{
+    std::string name;
+    Json::Value value;
+
+    if (!Reader.Next(name, value)) {
+        return false;
+    }
+
+    std::ofstream file(Dir + "/" + name);
+    Writer->write(value, &file);
+
+    if (!file) {
+        throw std::runtime_error("Failed to write template " + name);
+    }
+
+    ++UnpackedCount;
+    return true;
+}
+
+size_t TTemplatesUnpacker::GetUnpackedCount() const
+{
+    return UnpackedCount;
+}
+
+size_t TTemplatesUnpacker::GetTotalCount() const
+{
+    return Reader.GetTemplatesCount();
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <wblib/json_utils.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+// Reads templates pack made by wasm/tools/pack_templates.py. The pack is decompressed and decoded line by line,
+// so only shared subtrees and the current template are kept in memory.
+class TTemplatesPackReader
+{
+public:
+    /**
+     * @brief Opens the pack. Throws std::runtime_error if the pack can't be opened or has unknown format
+     */
+    explicit TTemplatesPackReader(const std::string& path);
+    ~TTemplatesPackReader();
+
+    TTemplatesPackReader(const TTemplatesPackReader&) = delete;
+    TTemplatesPackReader& operator=(const TTemplatesPackReader&) = delete;
+
+    /**
+     * @brief Reads next template, returns false at the end of the pack
+     */
+    bool Next(std::string& name, Json::Value& value);
+
+    size_t GetTemplatesCount() const;
+
+private:
+    bool ReadLine(std::string& line);
+    Json::Value ParseLine(const std::string& line);
+    void Resolve(Json::Value& value) const;
+
+    gzFile File;
+    std::string Buffer;
+    size_t Position = 0;
+    bool Eof = false;
+    size_t TemplatesCount = 0;
+    std::vector<Json::Value> Nodes;
+    std::unique_ptr<Json::CharReader> Reader;
+};
+
+// Unpacks templates of the pack into separate files one by one
+class TTemplatesUnpacker
+{
+public:
+    TTemplatesUnpacker(const std::string& packPath, const std::string& dir);
+
+    /**
+     * @brief Unpacks next template, returns false when all templates are unpacked
+     */
+    bool UnpackNext();
+
+    size_t GetUnpackedCount() const;
+    size_t GetTotalCount() const;
+
+private:
+    TTemplatesPackReader Reader;
+    std::string Dir;
+    std::unique_ptr<Json::StreamWriter> Writer;
+    size_t UnpackedCount = 0;
+};
@@ -0,0 +1,187 @@
+#include "wasm_trace.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std::chrono;
+
+namespace
+{
+    const uint8_t MAGIC[] = {'W', 'B', 'T', 'R', 1};
+
+    const auto TRUNCATED_ERROR = "trace is truncated";
+}
+
+namespace Trace
+{
+    TWriter::TWriter(): Data(std::begin(MAGIC), std::end(MAGIC)), Last(steady_clock::now())
+    {}
+
+    void TWriter::AddSettings(int baudRate, int dataBits, char parity, int stopBits)
+    {
+        AddHeader(TRecordType::Settings);
+        AddNumber(baudRate);
+        Data.push_back(dataBits);
+        Data.push_back(parity);
+        Data.push_back(stopBits);
+    }
+
+    void TWriter::AddWrite(const std::vector<uint8_t>& data)
+    {
+        AddHeader(TRecordType::Write);
+        AddBytes(data.data(), data.size());
+    }
+
+    void TWriter::AddExchange(const std::vector<uint8_t>& request,
+                              size_t count,
+                              int timeout,
+                              int frameGap,
+                              const std::vector<uint8_t>& reply,
+                              const microseconds& duration)
+    {
+        AddHeader(TRecordType::Exchange);
+        AddBytes(request.data(), request.size());
+        AddNumber(count);
+        AddNumber(timeout);
+        AddNumber(frameGap);
+        AddNumber(duration.count());
+        AddBytes(reply.data(), reply.size());
+    }
+
+    void TWriter::AddListen(int duration, const std::vector<uint8_t>& data, const microseconds& elapsed)
+    {
+        AddHeader(TRecordType::Listen);
+        AddNumber(duration);
+        AddNumber(elapsed.count());
+        AddBytes(data.data(), data.size());
+    }
+
+    void TWriter::AddRequest(const std::string& name, const std::string& data)
+    {
+        AddHeader(TRecordType::Request);
+        AddBytes(reinterpret_cast<const uint8_t*>(name.data()), name.size());
+        AddBytes(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+    }
+
+    const std::vector<uint8_t>& TWriter::GetData() const
+    {
+        return Data;
+    }
+
+    void TWriter::AddHeader(TRecordType type)
+    {
+        auto now = steady_clock::now();
+        Data.push_back(static_cast<uint8_t>(type));
+        AddNumber(duration_cast<microseconds>(now - Last).count());
+        Last = now;
+    }
+
+    // LEB128, 7 bits per byte starting from the lowest ones
+    void TWriter::AddNumber(uint64_t value)
+    {
+        do {
+            uint8_t byte = value & 0x7F;
+            value >>= 7;
+            Data.push_back(value ? byte | 0x80 : byte);
+        } while (value);
+    }
+
+    void TWriter::AddBytes(const uint8_t* data, size_t size)
+    {
+        AddNumber(size);
+        Data.insert(Data.end(), data, data + size);
+    }
+
+    TReader::TReader(std::vector<uint8_t> data): Data(std::move(data)), Pos(sizeof(MAGIC))
+    {
+        if (Data.size() < sizeof(MAGIC) || !std::equal(std::begin(MAGIC), std::end(MAGIC), Data.begin())) {
+            throw std::runtime_error("unsupported trace format");
+        }
+    }
+
+    bool TReader::Next(TRecord& record)
+    {
+        if (Pos >= Data.size()) {
+            return false;
+        }
+
+        record = TRecord();
+        record.Type = static_cast<TRecordType>(Data[Pos++]);
+        Time += microseconds(ReadNumber());
+        record.Time = Time;
+
+        switch (record.Type) {
+            case TRecordType::Settings:
+                record.BaudRate = ReadNumber();
+
+                if (Pos + 3 > Data.size()) {
+                    throw std::runtime_error(TRUNCATED_ERROR);
+                }
+
+                record.DataBits = Data[Pos++];
+                record.Parity = Data[Pos++];
+                record.StopBits = Data[Pos++];
+                break;
+            case TRecordType::Write:
+                record.Request = ReadBytes();
+                break;
+            case TRecordType::Exchange:
+                record.Request = ReadBytes();
+                record.Count = ReadNumber();
+                record.Timeout = ReadNumber();
+                record.FrameGap = ReadNumber();
+                record.Duration = microseconds(ReadNumber());
+                record.Reply = ReadBytes();
+                break;
+            case TRecordType::Listen:
+                record.Timeout = ReadNumber();
+                record.Duration = microseconds(ReadNumber());
+                record.Reply = ReadBytes();
+                break;
+            case TRecordType::Request: {
+                auto name = ReadBytes();
+                auto data = ReadBytes();
+                record.Name.assign(name.begin(), name.end());
+                record.Data.assign(data.begin(), data.end());
+                break;
+            }
+            default:
+                throw std::runtime_error("unknown trace record type " + std::to_string(static_cast<int>(record.Type)));
+        }
+
+        return true;
+    }
+
+    uint64_t TReader::ReadNumber()
+    {
+        uint64_t value = 0;
+
+        for (auto shift = 0; shift < 64; shift += 7) {
+            if (Pos >= Data.size()) {
+                throw std::runtime_error(TRUNCATED_ERROR);
+            }
+
+            auto byte = Data[Pos++];
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+
+            if (!(byte & 0x80)) {
+                return value;
+            }
+        }
+
+        throw std::runtime_error("trace number is too long");
+    }
+
+    std::vector<uint8_t> TReader::ReadBytes()
+    {
+        auto size = ReadNumber();
+
+        if (size > Data.size() - Pos) {
+            throw std::runtime_error(TRUNCATED_ERROR);
+        }
+
+        std::vector<uint8_t> data(Data.begin() + Pos, Data.begin() + Pos + size);
+        Pos += size;
+        return data;
+    }
+}
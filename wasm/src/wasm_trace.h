@@ -0,0 +1,95 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Compact binary trace of the port traffic. Each record has a type, the time since the previous record and
+// its fields, numbers are stored as variable length integers.
+namespace Trace
+{
+    enum class TRecordType : uint8_t
+    {
+        Settings = 'S',
+        Write = 'W',
+        Exchange = 'X',
+        Listen = 'L',
+        Request = 'R',
+    };
+
+    struct TRecord
+    {
+        TRecordType Type = TRecordType::Write;
+
+        // time since the trace start
+        std::chrono::microseconds Time = std::chrono::microseconds::zero();
+
+        // line settings
+        int BaudRate = 0;
+        int DataBits = 0;
+        char Parity = 'N';
+        int StopBits = 0;
+
+        // written request and received reply with parameters of the read
+        std::vector<uint8_t> Request;
+        std::vector<uint8_t> Reply;
+        size_t Count = 0;
+        int Timeout = 0;
+        int FrameGap = 0;
+        std::chrono::microseconds Duration = std::chrono::microseconds::zero();
+
+        // RPC sent to the module
+        std::string Name;
+        std::string Data;
+    };
+
+    class TWriter
+    {
+    public:
+        TWriter();
+
+        void AddSettings(int baudRate, int dataBits, char parity, int stopBits);
+        void AddWrite(const std::vector<uint8_t>& data);
+        void AddExchange(const std::vector<uint8_t>& request,
+                         size_t count,
+                         int timeout,
+                         int frameGap,
+                         const std::vector<uint8_t>& reply,
+                         const std::chrono::microseconds& duration);
+        void AddListen(int duration, const std::vector<uint8_t>& data, const std::chrono::microseconds& elapsed);
+        void AddRequest(const std::string& name, const std::string& data);
+
+        const std::vector<uint8_t>& GetData() const;
+
+    private:
+        std::vector<uint8_t> Data;
+        std::chrono::steady_clock::time_point Last;
+
+        void AddHeader(TRecordType type);
+        void AddNumber(uint64_t value);
+        void AddBytes(const uint8_t* data, size_t size);
+    };
+
+    class TReader
+    {
+    public:
+        /**
+         * @brief Throws std::runtime_error if the data isn't a trace
+         */
+        explicit TReader(std::vector<uint8_t> data);
+
+        /**
+         * @brief Reads the next record, returns false at the end of the trace
+         */
+        bool Next(TRecord& record);
+
+    private:
+        std::vector<uint8_t> Data;
+        size_t Pos;
+        std::chrono::microseconds Time = std::chrono::microseconds::zero();
+
+        uint64_t ReadNumber();
+        std::vector<uint8_t> ReadBytes();
+    };
+}
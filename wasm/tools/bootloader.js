@@ -0,0 +1,240 @@
+#!/usr/bin/env node
+// Runs a firmware update through the module in Node.js against a simulated WB device, so the update can be checked
+// without hardware. The device runs the main firmware at 9600 8N2 until it's asked to reboot to the bootloader, the
+// bootloader replies only at the given baud rates.
+//
+// Usage: node wasm/tools/bootloader.js [--in-bootloader] [--rates <baud rates>] [--lost <percent>] <firmware file>
+//
+// Bootloader rates are 9600 and 115200 by default. With --in-bootloader the device starts in the bootloader like
+// after a failed update. With --lost the given share of requests is lost, so retries of blocks are checked. Prints
+// the result of the update and exits with an error if the image written by the bootloader differs from the file.
+
+const fs = require('fs');
+const path = require('path');
+
+const createModule = require(path.join(__dirname, '..', 'public', 'module.js'));
+
+const SLAVE_ID = 1;
+const DEVICE_BAUD_RATE = 9600;
+const REBOOT_TO_BOOTLOADER_REGISTER = 129;
+const INFO_BLOCK_REGISTER = 0x1000;
+const DATA_BLOCK_REGISTER = 0x2000;
+
+// time of writing a block to flash and of erasing flash after the info block
+const BLOCK_WRITE_TIME = 5;
+const ERASE_TIME = 200;
+
+function crc16(data) {
+    let crc = 0xFFFF;
+
+    for (let byte of data) {
+        crc ^= byte;
+
+        for (let i = 0; i < 8; ++i)
+            crc = crc & 1 ? (crc >> 1) ^ 0xA001 : crc >> 1;
+    }
+
+    return crc;
+}
+
+function appendCrc(frame) {
+    let crc = crc16(frame);
+    return Uint8Array.from([...frame, crc & 0xFF, crc >> 8]);
+}
+
+// Device on the bus with the same interface as SerialPort in public/serial.js. Frames sent at another baud rate
+// than the one the device works at aren't received by it.
+class SimulatedDevice {
+    ioTime = 0;
+    written = 0;
+    inBootloader = false;
+    image = [];
+
+    constructor(rates, lost) {
+        this.rates = rates;
+        this.lost = lost;
+    }
+
+    setOptions(baudRate, dataBits, parity, stopBits) {
+        this.baudRate = baudRate;
+        this.byteTime = 1000 * (1 + dataBits + stopBits) / baudRate;
+    }
+
+    async measure(operation) {
+        let start = performance.now();
+        let result = await operation();
+        this.ioTime += performance.now() - start;
+        return result;
+    }
+
+    async write(data) {
+        // a lost request isn't executed, so the module repeats it
+        this.reply = Math.random() * 100 < this.lost ? null : this.execute(Uint8Array.from(data));
+        await this.wait(data.length * this.byteTime);
+    }
+
+    async transact(data, count, timeout, frameGap) {
+        await this.write(data);
+        return await this.read(count, timeout, frameGap);
+    }
+
+    async read(count, timeout, frameGap) {
+        let reply = this.reply;
+        delete this.reply;
+
+        if (!reply) {
+            await this.wait(timeout);
+            return new Uint8Array();
+        }
+
+        await this.wait(reply.delay + reply.data.length * this.byteTime);
+        return reply.data.slice(0, count);
+    }
+
+    async listen(duration) {
+        await this.wait(duration);
+        return new Uint8Array();
+    }
+
+    wait(ms) {
+        return new Promise((resolve) => setTimeout(resolve, ms));
+    }
+
+    // returns the reply to the request frame with the delay of the device, nothing if the device doesn't reply
+    execute(frame) {
+        let receives = this.inBootloader ? this.rates.includes(this.baudRate) : this.baudRate === DEVICE_BAUD_RATE;
+
+        if (!receives || frame.length < 8 || frame[0] !== SLAVE_ID)
+            return null;
+
+        let view = new DataView(frame.buffer);
+
+        if (crc16(frame.subarray(0, frame.length - 2)) !== view.getUint16(frame.length - 2, true))
+            return null;
+
+        let func = frame[1];
+        let address = view.getUint16(2);
+
+        if (!this.inBootloader) {
+            if (func !== 6 || address !== REBOOT_TO_BOOTLOADER_REGISTER)
+                return { data: appendCrc([SLAVE_ID, func | 0x80, 2]), delay: 1 };
+
+            console.log('device reboots to the bootloader');
+            this.inBootloader = true;
+            return { data: appendCrc(frame.subarray(0, 6)), delay: 1 };
+        }
+
+        // the bootloader accepts only writes of blocks
+        if (func !== 16)
+            return { data: appendCrc([SLAVE_ID, func | 0x80, 1]), delay: 1 };
+
+        let data = Array.from(frame.subarray(7, frame.length - 2));
+
+        if (address === INFO_BLOCK_REGISTER) {
+            this.image = data;
+            return { data: appendCrc(frame.subarray(0, 6)), delay: ERASE_TIME };
+        }
+
+        if (address !== DATA_BLOCK_REGISTER || !this.image.length)
+            return { data: appendCrc([SLAVE_ID, func | 0x80, 2]), delay: 1 };
+
+        this.image.push(...data);
+        return { data: appendCrc(frame.subarray(0, 6)), delay: BLOCK_WRITE_TIME };
+    }
+}
+
+// Same reply handling as ModuleInstance in public/script.js
+class BootloaderInstance {
+    constructor(serial) {
+        this.serial = serial;
+    }
+
+    async request(type, data) {
+        this.finished = false;
+        this[type](JSON.stringify(data));
+
+        while (!this.finished)
+            await new Promise((resolve) => setTimeout(resolve, 1));
+
+        return this.reply;
+    }
+
+    parseReply(reply) {
+        this.reply = JSON.parse(reply);
+        this.finished = true;
+    }
+
+    parseProgress(progress) {
+        let value = JSON.parse(progress);
+        process.stdout.write('\r' + value.written + ' / ' + value.total + ' bytes, ' + Math.round(value.speed) +
+                             ' B/s');
+    }
+
+    setStatus(text) {}
+
+    print(text) {
+        console.log(text);
+    }
+}
+
+async function main(args) {
+    let firmware = fs.readFileSync(args.file);
+    let device = new SimulatedDevice(args.rates, args.lost);
+    device.inBootloader = args.inBootloader;
+
+    let instance = await createModule(new BootloaderInstance(device));
+    instance.FS.writeFile('/firmware.wbfw', firmware);
+
+    let start = performance.now();
+    let reply = await instance.request('firmwareUpdate', {
+        file: '/firmware.wbfw',
+        slave_id: SLAVE_ID,
+        baud_rate: DEVICE_BAUD_RATE,
+        parity: 'N',
+        data_bits: 8,
+        stop_bits: 2,
+        in_bootloader: args.inBootloader,
+    });
+
+    console.log('\n' + JSON.stringify({ time: Math.round(performance.now() - start), ...reply }));
+
+    if (reply.error)
+        return 1;
+
+    // the last data block is padded by the module
+    let image = Buffer.from(device.image.slice(0, firmware.length));
+
+    if (!image.equals(firmware)) {
+        console.error('written image differs from the firmware file');
+        return 1;
+    }
+
+    return 0;
+}
+
+function parseArgs(argv) {
+    let args = { inBootloader: false, rates: [9600, 115200], lost: 0 };
+
+    for (let i = 0; i < argv.length; ++i) {
+        if (argv[i] === '--in-bootloader')
+            args.inBootloader = true;
+        else if (argv[i] === '--rates')
+            args.rates = argv[++i].split(',').map((rate) => parseInt(rate));
+        else if (argv[i] === '--lost')
+            args.lost = Number(argv[++i]);
+        else
+            args.file = argv[i];
+    }
+
+    return args;
+}
+
+let args = parseArgs(process.argv.slice(2));
+
+if (!args.file) {
+    console.error('Usage: ' + path.basename(process.argv[1]) +
+                  ' [--in-bootloader] [--rates <baud rates>] [--lost <percent>] <firmware file>');
+    process.exit(1);
+}
+
+main(args).then((code) => process.exit(code));
@@ -0,0 +1,344 @@
+#!/usr/bin/env node
+// Stand-in for an Ethernet to RS-485 gateway to check the WebSocket transport without hardware. It accepts
+// WebSocket connections like the ones opened by public/websocket.js and serves simulated Modbus devices with
+// the line time of 9600 baud.
+//
+// Usage: node wasm/tools/gateway.js [--port <port>] [--devices <slave ids>] [--queue <requests>]
+//
+// Add the gateway in the page with ws://localhost:8502/rtu for RTU over TCP or ws://localhost:8502/tcp for
+// Modbus TCP. Devices have slave ids 1, 2 and 10 by default, holding and input registers hold their addresses.
+//
+// Requests are served one by one like on a real bus. In Modbus TCP mode the gateway queues requests and replies
+// to missing devices with the "gateway target device failed to respond" exception, in RTU mode they stay silent.
+// Requests above the queue size are dropped. The largest count of queued requests is printed, so pipelining of
+// the module can be checked against the queue size.
+
+const crypto = require('crypto');
+const http = require('http');
+
+const WEBSOCKET_GUID = '258EAFA5-E914-47DA-95CA-C5AB0DC85B11';
+
+const OPCODE_CONTINUATION = 0x0;
+const OPCODE_BINARY = 0x2;
+const OPCODE_CLOSE = 0x8;
+const OPCODE_PING = 0x9;
+const OPCODE_PONG = 0xA;
+
+const MBAP_HEADER_SIZE = 7;
+
+// time of one byte at 9600 baud, a device replies after a few milliseconds
+const BYTE_TIME = 11 / 9600 * 1000;
+const DEVICE_DELAY = 5;
+
+// time the gateway waits for a missing device before the exception reply
+const LINE_TIMEOUT = 100;
+
+const ILLEGAL_FUNCTION = 0x01;
+const ILLEGAL_DATA_ADDRESS = 0x02;
+const GATEWAY_TARGET_FAILED = 0x0B;
+
+function parseArgs(argv) {
+    let args = { port: 8502, devices: [1, 2, 10], queue: 16 };
+
+    for (let i = 0; i < argv.length; i += 2) {
+        if (argv[i] === '--port')
+            args.port = parseInt(argv[i + 1]);
+        else if (argv[i] === '--devices')
+            args.devices = argv[i + 1].split(',').map((id) => parseInt(id));
+        else if (argv[i] === '--queue')
+            args.queue = parseInt(argv[i + 1]);
+        else
+            throw new Error('unknown argument ' + argv[i]);
+    }
+
+    return args;
+}
+
+function crc16(data) {
+    let crc = 0xFFFF;
+
+    for (let byte of data) {
+        crc ^= byte;
+
+        for (let i = 0; i < 8; ++i)
+            crc = crc & 1 ? (crc >> 1) ^ 0xA001 : crc >> 1;
+    }
+
+    return crc;
+}
+
+function appendCrc(frame) {
+    let crc = crc16(frame);
+    return Buffer.concat([frame, Buffer.from([crc & 0xFF, crc >> 8])]);
+}
+
+function isValidRtuFrame(frame) {
+    return frame.length >= 4 && crc16(frame.subarray(0, frame.length - 2)) === frame.readUInt16LE(frame.length - 2);
+}
+
+// Device with 16 bit registers and single bit coils, discrete inputs are coils and input registers are holding
+// registers, so written values can be read by any function
+class Device {
+    constructor() {
+        this.registers = new Uint16Array(0x10000).map((value, address) => address);
+        this.coils = new Uint8Array(0x10000);
+    }
+
+    // returns the reply PDU to the request PDU
+    execute(pdu) {
+        let func = pdu[0];
+        let address = pdu.length >= 3 ? pdu.readUInt16BE(1) : 0;
+        let count = pdu.length >= 5 ? pdu.readUInt16BE(3) : 0;
+
+        switch (func) {
+            case 1:
+            case 2: {
+                if (!count || count > 2000 || address + count > 0x10000)
+                    return this.exception(func, ILLEGAL_DATA_ADDRESS);
+
+                let bytes = Buffer.alloc(Math.ceil(count / 8));
+
+                for (let i = 0; i < count; ++i)
+                    bytes[i >> 3] |= this.coils[address + i] << (i & 7);
+
+                return Buffer.concat([Buffer.from([func, bytes.length]), bytes]);
+            }
+
+            case 3:
+            case 4: {
+                if (!count || count > 125 || address + count > 0x10000)
+                    return this.exception(func, ILLEGAL_DATA_ADDRESS);
+
+                let bytes = Buffer.alloc(count * 2);
+
+                for (let i = 0; i < count; ++i)
+                    bytes.writeUInt16BE(this.registers[address + i], i * 2);
+
+                return Buffer.concat([Buffer.from([func, bytes.length]), bytes]);
+            }
+
+            case 5:
+                this.coils[address] = pdu.readUInt16BE(3) === 0xFF00 ? 1 : 0;
+                return pdu.subarray(0, 5);
+
+            case 6:
+                this.registers[address] = pdu.readUInt16BE(3);
+                return pdu.subarray(0, 5);
+
+            case 15:
+                for (let i = 0; i < count; ++i)
+                    this.coils[address + i] = (pdu[6 + (i >> 3)] >> (i & 7)) & 1;
+
+                return pdu.subarray(0, 5);
+
+            case 16:
+                for (let i = 0; i < count; ++i)
+                    this.registers[address + i] = pdu.readUInt16BE(6 + i * 2);
+
+                return pdu.subarray(0, 5);
+        }
+
+        return this.exception(func, ILLEGAL_FUNCTION);
+    }
+
+    exception(func, code) {
+        return Buffer.from([func | 0x80, code]);
+    }
+}
+
+// Connection of the module, requests are framed as RTU frames or Modbus TCP frames and are served in turn
+class Connection {
+    constructor(socket, modbusTcp, devices, queueSize) {
+        this.socket = socket;
+        this.modbusTcp = modbusTcp;
+        this.devices = devices;
+        this.queueSize = queueSize;
+        this.queue = [];
+        this.maxQueued = 0;
+        this.received = Buffer.alloc(0);
+        this.message = Buffer.alloc(0);
+
+        socket.on('data', (data) => this.onData(data));
+        socket.on('close', () => console.log('connection closed, max ' + this.maxQueued + ' requests queued'));
+        socket.on('error', (error) => console.error(error.message));
+    }
+
+    onData(data) {
+        this.received = Buffer.concat([this.received, data]);
+
+        while (this.received.length >= 2) {
+            let length = this.received[1] & 0x7F;
+            let offset = 2;
+
+            if (length === 126) {
+                if (this.received.length < 4)
+                    return;
+
+                length = this.received.readUInt16BE(2);
+                offset = 4;
+            } else if (length === 127) {
+                if (this.received.length < 10)
+                    return;
+
+                length = Number(this.received.readBigUInt64BE(2));
+                offset = 10;
+            }
+
+            // frames of clients are always masked
+            if (this.received.length < offset + 4 + length)
+                return;
+
+            let fin = this.received[0] & 0x80;
+            let opcode = this.received[0] & 0x0F;
+            let mask = this.received.subarray(offset, offset + 4);
+            let payload = Buffer.from(this.received.subarray(offset + 4, offset + 4 + length));
+            this.received = this.received.subarray(offset + 4 + length);
+
+            for (let i = 0; i < payload.length; ++i)
+                payload[i] ^= mask[i & 3];
+
+            if (opcode === OPCODE_BINARY || opcode === OPCODE_CONTINUATION) {
+                this.message = Buffer.concat([this.message, payload]);
+
+                if (fin) {
+                    this.onMessage(this.message);
+                    this.message = Buffer.alloc(0);
+                }
+            } else if (opcode === OPCODE_PING) {
+                this.send(payload, OPCODE_PONG);
+            } else if (opcode === OPCODE_CLOSE) {
+                this.send(Buffer.alloc(0), OPCODE_CLOSE);
+                this.socket.end();
+            }
+        }
+    }
+
+    send(payload, opcode = OPCODE_BINARY) {
+        let header;
+
+        if (payload.length < 126) {
+            header = Buffer.from([0x80 | opcode, payload.length]);
+        } else {
+            header = Buffer.from([0x80 | opcode, 126, 0, 0]);
+            header.writeUInt16BE(payload.length, 2);
+        }
+
+        if (!this.socket.destroyed)
+            this.socket.write(Buffer.concat([header, payload]));
+    }
+
+    // An RTU message is one frame like a frame ended by the line gap, a Modbus TCP message may hold several frames
+    onMessage(message) {
+        if (!this.modbusTcp) {
+            this.enqueue({ frame: message });
+            return;
+        }
+
+        while (message.length >= MBAP_HEADER_SIZE) {
+            let size = 6 + message.readUInt16BE(4);
+
+            if (message.length < size)
+                break;
+
+            this.enqueue({ frame: message.subarray(0, size) });
+            message = message.subarray(size);
+        }
+    }
+
+    enqueue(request) {
+        if (this.queue.length >= this.queueSize) {
+            console.log('queue is full, request is dropped');
+            return;
+        }
+
+        this.queue.push(request);
+
+        if (this.queue.length > this.maxQueued) {
+            this.maxQueued = this.queue.length;
+            console.log('max ' + this.maxQueued + ' requests queued');
+        }
+
+        if (this.queue.length === 1)
+            this.serveNext();
+    }
+
+    serveNext() {
+        if (!this.queue.length)
+            return;
+
+        let { frame } = this.queue[0];
+        let finish = (reply, delay) => {
+            setTimeout(() => {
+                if (reply)
+                    this.send(reply);
+
+                this.queue.shift();
+                this.serveNext();
+            }, delay);
+        };
+
+        if (this.modbusTcp) {
+            let unit = frame[MBAP_HEADER_SIZE - 1];
+            let device = this.devices.get(unit);
+            let pdu = frame.subarray(MBAP_HEADER_SIZE);
+            let replyPdu = device ? device.execute(pdu) : Buffer.from([pdu[0] | 0x80, GATEWAY_TARGET_FAILED]);
+            let header = Buffer.from(frame.subarray(0, MBAP_HEADER_SIZE));
+            header.writeUInt16BE(replyPdu.length + 1, 4);
+
+            // the gateway sends the request as an RTU frame with slave id and CRC
+            let delay = device ? (pdu.length + replyPdu.length + 6) * BYTE_TIME + DEVICE_DELAY : LINE_TIMEOUT;
+            finish(Buffer.concat([header, replyPdu]), delay);
+            return;
+        }
+
+        let device = this.devices.get(frame[0]);
+
+        // broadcasts and frames for missing devices occupy the line until the timeout of the module
+        if (!device || !isValidRtuFrame(frame)) {
+            finish(null, frame.length * BYTE_TIME);
+            return;
+        }
+
+        let replyPdu = device.execute(frame.subarray(1, frame.length - 2));
+        let reply = appendCrc(Buffer.concat([frame.subarray(0, 1), replyPdu]));
+        finish(reply, (frame.length + reply.length) * BYTE_TIME + DEVICE_DELAY);
+    }
+}
+
+function main() {
+    let args = parseArgs(process.argv.slice(2));
+    let devices = new Map(args.devices.map((slaveId) => [slaveId, new Device()]));
+
+    let server = http.createServer((request, response) => {
+        response.writeHead(426);
+        response.end('WebSocket connection is expected\n');
+    });
+
+    server.on('upgrade', (request, socket) => {
+        let key = request.headers['sec-websocket-key'];
+        let framing = new URL(request.url, 'ws://localhost').pathname;
+
+        if (!key || (framing !== '/rtu' && framing !== '/tcp')) {
+            socket.end('HTTP/1.1 400 Bad Request\r\n\r\n');
+            return;
+        }
+
+        let accept = crypto.createHash('sha1').update(key + WEBSOCKET_GUID).digest('base64');
+        socket.write('HTTP/1.1 101 Switching Protocols\r\n' +
+                     'Upgrade: websocket\r\n' +
+                     'Connection: Upgrade\r\n' +
+                     'Sec-WebSocket-Accept: ' + accept + '\r\n\r\n');
+        socket.setNoDelay(true);
+
+        console.log((framing === '/tcp' ? 'Modbus TCP' : 'RTU over TCP') + ' connection from ' +
+                    socket.remoteAddress);
+        new Connection(socket, framing === '/tcp', devices, args.queue);
+    });
+
+    server.listen(args.port, () => {
+        console.log('gateway listens on ws://localhost:' + args.port + '/rtu and ws://localhost:' + args.port +
+                    '/tcp, devices ' + args.devices.join(', '));
+    });
+}
+
+main();
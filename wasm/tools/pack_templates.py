@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+"""
+Packs device templates into a single gzip-compressed file with identical JSON subtrees stored once.
+
+Every line of the pack is a JSON object:
+    {"format": "wb-templates-pack", "version": 1,  header
+     "templates": <number of templates>}
+    {"node": <id>, "value": <json>}                 shared subtree
+    {"template": <file name>, "value": <json>}      template
+Shared subtrees are referenced as {"$pack": <id>} and always precede the lines that use them,
+so the pack can be unpacked in one pass (see wasm/src/wasm_templates_pack.cpp).
+"""
+
+import argparse
+import gzip
+import json
+import os
+import sys
+
+FORMAT = "wb-templates-pack"
+VERSION = 1
+
+# smaller subtrees take less space inline than as references
+MIN_SHARED_SIZE = 64
+
+
+def canonical(value):
+    return json.dumps(value, sort_keys=True, separators=(",", ":"), ensure_ascii=False)
+
+
+def count_subtrees(value, counts):
+    if isinstance(value, dict):
+        children = value.values()
+    elif isinstance(value, list):
+        children = value
+    else:
+        return
+
+    key = canonical(value)
+    counts[key] = counts.get(key, 0) + 1
+
+    # subtrees of a repeated subtree are stored inside its single copy
+    if counts[key] > 1:
+        return
+
+    for child in children:
+        count_subtrees(child, counts)
+
+
+class Packer:
+    def __init__(self, counts, out):
+        self.shared = {key for key, count in counts.items() if count > 1 and len(key) >= MIN_SHARED_SIZE}
+        self.ids = {}
+        self.out = out
+
+    def write(self, record):
+        self.out.write(json.dumps(record, separators=(",", ":"), ensure_ascii=False).encode("utf-8"))
+        self.out.write(b"\n")
+
+    def replace(self, value, root=False):
+        if not isinstance(value, (dict, list)):
+            return value
+
+        key = canonical(value)
+
+        if not root and key in self.shared:
+            if key not in self.ids:
+                node = self.replace(value, root=True)
+                self.ids[key] = len(self.ids)
+                self.write({"node": self.ids[key], "value": node})
+            return {"$pack": self.ids[key]}
+
+        if isinstance(value, dict):
+            return {name: self.replace(child) for name, child in value.items()}
+
+        return [self.replace(child) for child in value]
+
+    def pack(self, name, value):
+        self.write({"template": name, "value": self.replace(value, root=True)})
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Pack device templates")
+    parser.add_argument("templates_dir")
+    parser.add_argument("pack")
+    args = parser.parse_args()
+
+    templates = {}
+
+    for name in sorted(os.listdir(args.templates_dir)):
+        if name.endswith(".json"):
+            with open(os.path.join(args.templates_dir, name), encoding="utf-8") as f:
+                templates[name] = json.load(f)
+
+    counts = {}
+
+    for value in templates.values():
+        count_subtrees(value, counts)
+
+    with gzip.open(args.pack, "wb", compresslevel=9) as out:
+        packer = Packer(counts, out)
+        packer.write({"format": FORMAT, "version": VERSION, "templates": len(templates)})
+
+        for name, value in templates.items():
+            packer.pack(name, value)
+
+    print(
+        "packed %d templates, %d shared subtrees, %d bytes"
+        % (len(templates), len(packer.ids), os.path.getsize(args.pack)),
+        file=sys.stderr,
+    )
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,192 @@
+#!/usr/bin/env node
+// Replays a serial trace saved by the page with ?trace=1 through the module's RPC stack in Node.js. The module
+// port returns recorded replies, so a session from the field runs the same code paths as a repeatable benchmark.
+//
+// Usage: node wasm/tools/replay.js [--no-transact] <trace file> [speed]
+//        node wasm/tools/replay.js --soak <cycles> <trace file>
+//
+// Speed 1 keeps the recorded timing of requests and bus operations, higher values replay faster and 0 replays
+// without waiting. Prints the time and the heap usage change of each request and exits with an error if the replay
+// went another way than the recorded session or if schemas were generated, but none was read from precomputed files.
+//
+// The module logs the Asyncify overhead per transaction after each request. To benchmark sending of requests
+// together with reading of replies, compare the logs of a replay at speed 0 with the ones of the same replay with
+// --no-transact, which writes requests and reads replies in separate calls like the page with ?transact=0.
+//
+// The soak mode replays the trace the given number of times without waiting, like a session left open for hours,
+// prints heap statistics every 100 cycles and exits with an error if the heap keeps growing after the first cycle.
+
+const fs = require('fs');
+const path = require('path');
+
+const createModule = require(path.join(__dirname, '..', 'public', 'module.js'));
+
+// Same reply handling as ModuleInstance in public/script.js, requests are executed one by one
+class ReplayInstance {
+    async request(type, data) {
+        this.finished = false;
+        this[type](JSON.stringify(data));
+
+        while (!this.finished)
+            await new Promise((resolve) => setTimeout(resolve, 1));
+
+        return this.reply;
+    }
+
+    parseReply(reply) {
+        this.reply = JSON.parse(reply);
+        this.finished = true;
+    }
+
+    parseProgress(progress) {}
+
+    setStatus(text) {}
+
+    print(text) {
+        console.log(text);
+    }
+}
+
+const SOAK_REPORT_CYCLES = 100;
+
+// heap growth between the first and the last soak cycle which is taken as a leak
+const SOAK_MAX_GROWTH = 1024 * 1024;
+
+async function createInstance(file) {
+    let instance = await createModule(new ReplayInstance());
+    let start = performance.now();
+
+    while (!(await instance.request('init', {})).result?.finished) {}
+
+    console.log('module initialized in ' + Math.round(performance.now() - start) + ' ms');
+
+    instance.FS.writeFile('/replay.wbtr', fs.readFileSync(file));
+    return instance;
+}
+
+async function main(file, speed, transact) {
+    let instance = await createInstance(file);
+
+    let reply = await instance.request('replayStart', { file: '/replay.wbtr', speed: speed });
+
+    if (reply.error) {
+        console.error('Can\'t replay ' + file + ': ' + reply.error.message);
+        return 1;
+    }
+
+    instance.setTransactEnabled(transact);
+
+    let requests = reply.result.requests;
+    let total = 0;
+    let start = performance.now();
+
+    for (let item of requests) {
+        // requests are sent at their recorded time unless the previous ones took longer
+        if (speed > 0) {
+            let delay = item.time / speed - (performance.now() - start);
+
+            if (delay > 0)
+                await new Promise((resolve) => setTimeout(resolve, delay));
+        }
+
+        let heapUsed = instance.getHeapUsage().used;
+        let requestStart = performance.now();
+        let result = await instance.request(item.type, JSON.parse(item.data));
+        let time = performance.now() - requestStart;
+
+        total += time;
+        console.log(item.type + ': ' + time.toFixed(1) + ' ms, heap ' +
+                    ((instance.getHeapUsage().used - heapUsed) / 1024).toFixed(1) + ' KB' +
+                    (result.error ? ', error: ' + result.error.message : ''));
+    }
+
+    let stats = (await instance.request('replayStats', {})).result;
+
+    console.log(JSON.stringify({
+        requests: requests.length,
+        request_time: Math.round(total),
+        total_time: Math.round(performance.now() - start),
+        operations: stats.operations,
+        mismatches: stats.mismatches,
+        missing: stats.missing,
+        schemas_precomputed: stats.schemas_precomputed,
+        schemas_generated: stats.schemas_generated,
+        heap_size: instance.getHeapUsage().size,
+    }));
+
+    // only schemas of custom templates are generated at runtime, if no schema was read from precomputed files, the
+    // module looks for them at another path than the one the build writes them to
+    if (stats.schemas_generated && !stats.schemas_precomputed) {
+        console.error('no precomputed schemas were used');
+        return 1;
+    }
+
+    return stats.mismatches || stats.missing ? 1 : 0;
+}
+
+async function soak(file, cycles) {
+    let instance = await createInstance(file);
+    let start = performance.now();
+    let baseline = 0;
+    let failures = 0;
+
+    for (let cycle = 1; cycle <= cycles; ++cycle) {
+        // each cycle starts the trace from the beginning, replies and device states repeat the recorded session
+        let reply = await instance.request('replayStart', { file: '/replay.wbtr', speed: 0 });
+
+        if (reply.error) {
+            console.error('Can\'t replay ' + file + ': ' + reply.error.message);
+            return 1;
+        }
+
+        for (let item of reply.result.requests)
+            await instance.request(item.type, JSON.parse(item.data));
+
+        let stats = (await instance.request('replayStats', {})).result;
+
+        if (stats.mismatches || stats.missing)
+            ++failures;
+
+        // the first cycle fills caches, further ones must not grow the heap
+        if (cycle == 1)
+            baseline = instance.getHeapUsage().used;
+
+        if (cycle % SOAK_REPORT_CYCLES == 0 || cycle == cycles) {
+            let heap = (await instance.request('heapStats', {})).result;
+
+            console.log(JSON.stringify({
+                cycle: cycle,
+                time: Math.round(performance.now() - start),
+                failures: failures,
+                ...heap,
+            }));
+        }
+    }
+
+    let growth = instance.getHeapUsage().used - baseline;
+
+    console.log('heap growth after the first cycle: ' + (growth / 1024).toFixed(1) + ' KB');
+
+    if (growth > SOAK_MAX_GROWTH) {
+        console.error('heap keeps growing, possible leak');
+        return 1;
+    }
+
+    return failures ? 1 : 0;
+}
+
+let args = process.argv.slice(2);
+let transact = args[0] != '--no-transact';
+
+if (!transact)
+    args.shift();
+
+if (args[0] == '--soak' && args.length > 2) {
+    soak(args[2], Number(args[1])).then((code) => process.exit(code));
+} else if (args.length > 0 && args[0] != '--soak') {
+    main(args[0], args.length > 1 ? Number(args[1]) : 1, transact).then((code) => process.exit(code));
+} else {
+    console.error('Usage: ' + path.basename(process.argv[1]) + ' [--no-transact] <trace file> [speed]');
+    console.error('       ' + path.basename(process.argv[1]) + ' --soak <cycles> <trace file>');
+    process.exit(1);
+}
@@ -0,0 +1,98 @@
+#include "log.h"
+#include "wasm_precomputed.h"
+
+#include "rpc/rpc_config_handler.h"
+#include "rpc/rpc_helpers.h"
+
+#include <filesystem>
+#include <iostream>
+#include <set>
+
+#define LOG(logger) logger.Log() << "[schemas generator] "
+
+// Build-time run of the module's schema generation (see the schemas target in wasm.mk). Runs in the assets
+// directory with the unpacked templates directory as an argument and writes finished device type lists and device
+// schemas, which the module serves instead of generating them in the browser.
+
+namespace
+{
+    const auto GROUP_NAMES_FILE = "groups.json";
+
+    const auto COMMON_SCHEMA_FILE = "wb-mqtt-serial-confed-common.schema.json";
+    const auto PORTS_SCHEMA_FILE = "wb-mqtt-serial-ports.schema.json";
+    const auto TEMPLATES_SCHEMA_FILE = "wb-mqtt-serial-device-template.schema.json";
+
+    const auto PROTOCOLS_DIR = "protocols";
+
+    const std::vector<std::string> LANGUAGES = {"en", "ru"};
+
+    std::string Serialize(const Json::Value& value)
+    {
+        std::stringstream stream;
+        WBMQTT::JSON::MakeWriter()->write(value, &stream);
+        return stream.str();
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2) {
+        std::cerr << "Usage: " << argv[0] << " <templates dir>" << std::endl;
+        return 1;
+    }
+
+    try {
+        TSerialDeviceFactory deviceFactory;
+        RegisterProtocols(deviceFactory);
+
+        auto commonSchema = WBMQTT::JSON::Parse(COMMON_SCHEMA_FILE);
+        auto templateMap =
+            std::make_shared<TTemplateMap>(LoadConfigTemplatesSchema(TEMPLATES_SCHEMA_FILE, commonSchema));
+        TDevicesConfedSchemasMap devicesSchemasMap(*templateMap, deviceFactory, commonSchema);
+        TProtocolConfedSchemasMap protocolSchemasMap(PROTOCOLS_DIR, commonSchema);
+        TRPCConfigHandler configHandler(WBMQTT::JSON::Parse(PORTS_SCHEMA_FILE),
+                                        templateMap,
+                                        devicesSchemasMap,
+                                        protocolSchemasMap,
+                                        WBMQTT::JSON::Parse(GROUP_NAMES_FILE));
+        templateMap->AddTemplatesDir(argv[1]);
+
+        std::filesystem::create_directories(Precomputed::DIR);
+        std::set<std::string> deviceTypes;
+
+        for (const auto& lang: LANGUAGES) {
+            Json::Value request;
+            request["lang"] = lang;
+
+            auto groups = configHandler.GetDeviceTypes(request);
+
+            for (const auto& group: groups) {
+                for (const auto& type: group["types"]) {
+                    deviceTypes.insert(type["type"].asString());
+                }
+            }
+
+            Precomputed::Write(Precomputed::GetDeviceTypesPath(lang), Serialize(groups));
+        }
+
+        // schemas hold translations for all languages, so one schema is written per device type
+        for (const auto& deviceType: deviceTypes) {
+            Json::Value request;
+            request["type"] = deviceType;
+
+            try {
+                Precomputed::Write(Precomputed::GetSchemaPath(deviceType), Serialize(configHandler.GetSchema(request)));
+            } catch (const std::exception& e) {
+                // the module falls back to runtime generation for this device type
+                LOG(Warn) << "Unable to generate schema for " << deviceType << ": " << e.what();
+            }
+        }
+
+        LOG(Info) << "Generated " << deviceTypes.size() << " device schemas";
+    } catch (const std::exception& e) {
+        LOG(Error) << e.what();
+        return 1;
+    }
+
+    return 0;
+}
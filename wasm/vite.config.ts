@@ -24,12 +24,12 @@ export default defineConfig(() => {
             },
             {
               tag: 'script',
-              attrs: { src: '/script.js', async: true },
+              attrs: { src: '/websocket.js', async: true },
               injectTo: 'head',
             },
             {
               tag: 'script',
-              attrs: { src: '/module.js', async: true },
+              attrs: { src: '/script.js', async: true },
               injectTo: 'head',
             },
           ];